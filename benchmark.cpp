@@ -0,0 +1,862 @@
+//   Copyright 2019 SiLeader and Cerussite.
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <forward_list>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "black.hpp"
+
+namespace {
+    /// allocator of int owned by the benchmark.
+    /// containers construct their own allocator.
+    template <class Allocator> struct Owned {
+        using allocator_type = Allocator;
+
+        Allocator allocator;
+
+        template <class Container> Container make() { return Container(); }
+    };
+
+    /// polymorphic allocator of int over a resource owned by the benchmark
+    template <class Resource> struct Pmr {
+        using allocator_type = std::pmr::polymorphic_allocator<int>;
+
+        Resource resource;
+        allocator_type allocator{&resource};
+
+        template <class Container> Container make() { return Container(&resource); }
+    };
+
+    namespace subsystems = black::subsystems;
+    namespace sources = black::sources;
+
+    using Std = Owned<std::allocator<int>>;
+    using Bit = Owned<black::BlockAllocator<int>>;
+    using LinkedList =
+        Owned<black::BlockAllocator<int, subsystems::LinkedListAllocationSubsystem<int, 64>>>;
+    using Hierarchical = Owned<
+        black::BlockAllocator<int, subsystems::HierarchicalBitAllocationSubsystem<int, 4096>>>;
+    using Arena = Owned<black::BlockAllocator<int, subsystems::MonotonicAllocationSubsystem<int>>>;
+    using Shared = Owned<black::SharedBlockAllocator<int>>;
+    using Mmap =
+        Owned<black::BlockAllocator<int, subsystems::HierarchicalBitAllocationSubsystem<int, 4096>,
+                                    sources::MmapSource<>>>;
+    using HugePage =
+        Owned<black::BlockAllocator<int, subsystems::HierarchicalBitAllocationSubsystem<int, 4096>,
+                                    sources::MmapSource<sources::HugePage::Transparent>>>;
+    using Concurrent = Owned<black::ConcurrentBlockAllocator<int>>;
+    using Atomic = Owned<black::BlockAllocator<int, subsystems::AtomicBitAllocationSubsystem<int>>>;
+    using BitCacheLine = Owned<black::BlockAllocator<
+        int, subsystems::BitAllocationSubsystem<int, black::layouts::CacheLine>>>;
+    using HierarchicalCacheLine = Owned<black::BlockAllocator<
+        int, subsystems::HierarchicalBitAllocationSubsystem<int, 4096, black::layouts::CacheLine>>>;
+    using HierarchicalAuto =
+        Owned<black::BlockAllocator<int, subsystems::HierarchicalBitAllocationSubsystem<int>>>;
+    using PmrPool = Pmr<std::pmr::unsynchronized_pool_resource>;
+    using PmrSynchronizedPool = Pmr<std::pmr::synchronized_pool_resource>;
+    using BlackPool = Pmr<black::PoolResource>;
+
+    /// node of a singly linked list linked by pointers
+    struct PointerNode {
+        PointerNode *next;
+        int value;
+    };
+
+    /// node of a singly linked list linked by 32 bit handles
+    struct HandleNode;
+    using PointerNodeAllocator = black::BlockAllocator<
+        PointerNode, subsystems::HierarchicalBitAllocationSubsystem<PointerNode, 4000>>;
+    using HandleNodeAllocator = black::HandleAllocator<
+        HandleNode, subsystems::HierarchicalBitAllocationSubsystem<HandleNode, 4000>>;
+    struct HandleNode {
+        black::Handle<HandleNode, HandleNodeAllocator> next;
+        int value;
+    };
+
+    template <class Context, class T>
+    using Rebind = typename std::allocator_traits<
+        typename Context::allocator_type>::template rebind_alloc<T>;
+
+    template <class Context> using List = std::list<int, Rebind<Context, int>>;
+    template <class Context> using ForwardList = std::forward_list<int, Rebind<Context, int>>;
+    template <class Context>
+    using Map = std::map<int, int, std::less<int>, Rebind<Context, std::pair<const int, int>>>;
+
+    /// \return 0 to count - 1 in random order
+    std::vector<std::size_t> permutation(std::size_t count) {
+        std::vector<std::size_t> indices(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            indices[i] = i;
+        }
+        std::shuffle(indices.begin(), indices.end(), std::mt19937(0));
+        return indices;
+    }
+
+    /// build a std::list of range(0) nodes and destroy it
+    template <class Context> void listLifetime(benchmark::State &state) {
+        const auto count = static_cast<std::size_t>(state.range(0));
+        Context context;
+        for (auto _ : state) {
+            auto ls = context.template make<List<Context>>();
+            for (std::size_t i = 0; i < count; ++i) {
+                ls.emplace_back(static_cast<int>(i));
+            }
+            benchmark::DoNotOptimize(ls.back());
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+
+    /// build a std::forward_list of range(0) nodes and destroy it
+    template <class Context> void forwardListLifetime(benchmark::State &state) {
+        const auto count = static_cast<std::size_t>(state.range(0));
+        Context context;
+        for (auto _ : state) {
+            auto ls = context.template make<ForwardList<Context>>();
+            for (std::size_t i = 0; i < count; ++i) {
+                ls.emplace_front(static_cast<int>(i));
+            }
+            benchmark::DoNotOptimize(ls.front());
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+
+    /// build a std::map of range(0) random keys and destroy it
+    template <class Context> void mapLifetime(benchmark::State &state) {
+        const auto keys = permutation(static_cast<std::size_t>(state.range(0)));
+        Context context;
+        for (auto _ : state) {
+            auto map = context.template make<Map<Context>>();
+            for (auto key : keys) {
+                map.emplace(static_cast<int>(key), 0);
+            }
+            benchmark::DoNotOptimize(map.size());
+        }
+        state.SetItemsProcessed(state.iterations() * keys.size());
+    }
+
+    /// allocate range(0) objects and free them in random order
+    template <class Context> void randomOrderFree(benchmark::State &state) {
+        const auto order = permutation(static_cast<std::size_t>(state.range(0)));
+        Context context;
+        auto &allocator = context.allocator;
+        std::vector<int *> pointers(order.size());
+        for (auto _ : state) {
+            for (auto &ptr : pointers) {
+                ptr = allocator.allocate(1);
+            }
+            for (auto index : order) {
+                allocator.deallocate(pointers[index], 1);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * order.size());
+    }
+
+    /// fill range(0) chunks and free every object in random order.
+    /// the cost of a free must not depend on the chunk count.
+    template <class Context> void chunkFree(benchmark::State &state) {
+        using Allocator = typename Context::allocator_type;
+        constexpr auto kObjectCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+        const auto order = permutation(static_cast<std::size_t>(state.range(0)) * kObjectCount);
+        Context context;
+        auto &allocator = context.allocator;
+        std::vector<int *> pointers(order.size());
+        for (auto _ : state) {
+            state.PauseTiming();
+            for (auto &ptr : pointers) {
+                ptr = allocator.allocate(1);
+            }
+            state.ResumeTiming();
+            for (auto index : order) {
+                allocator.deallocate(pointers[index], 1);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * order.size());
+        state.counters["per_free"] = benchmark::Counter(
+            static_cast<double>(order.size()),
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+    }
+
+    /// keep range(1) percent of range(0) objects, and replace a random one repeatedly
+    template <class Context> void churn(benchmark::State &state) {
+        const auto capacity = static_cast<std::size_t>(state.range(0));
+        const auto liveCount = capacity * static_cast<std::size_t>(state.range(1)) / 100;
+        Context context;
+        auto &allocator = context.allocator;
+
+        // free objects in random order, so chunks are used evenly
+        std::vector<int *> pointers(capacity);
+        for (auto &ptr : pointers) {
+            ptr = allocator.allocate(1);
+        }
+        auto order = permutation(capacity);
+        for (std::size_t i = liveCount; i < capacity; ++i) {
+            allocator.deallocate(pointers[order[i]], 1);
+        }
+        std::vector<int *> live(liveCount);
+        for (std::size_t i = 0; i < liveCount; ++i) {
+            live[i] = pointers[order[i]];
+        }
+
+        std::mt19937 engine(0);
+        std::uniform_int_distribution<std::size_t> slot(0, liveCount - 1);
+        std::vector<std::size_t> slots(1 << 16);
+        for (auto &index : slots) {
+            index = slot(engine);
+        }
+
+        std::size_t step = 0;
+        for (auto _ : state) {
+            auto &ptr = live[slots[step++ % slots.size()]];
+            allocator.deallocate(ptr, 1);
+            ptr = allocator.allocate(1);
+        }
+        for (auto ptr : live) {
+            allocator.deallocate(ptr, 1);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// allocate 256 arrays of range(0) objects and free them
+    template <class Context> void arrays(benchmark::State &state) {
+        const auto length = static_cast<std::size_t>(state.range(0));
+        Context context;
+        auto &allocator = context.allocator;
+        std::vector<int *> pointers(256);
+        for (auto _ : state) {
+            for (auto &ptr : pointers) {
+                ptr = allocator.allocate(length);
+            }
+            for (auto ptr : pointers) {
+                allocator.deallocate(ptr, length);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * pointers.size());
+    }
+
+    /// keep 1024 arrays of random lengths up to range(0), and replace a random one.
+    /// arrays longer than a chunk are large, and must not slow down arrays in chunks.
+    template <class Context> void mixedArrays(benchmark::State &state) {
+        Context context;
+        auto &allocator = context.allocator;
+        std::mt19937 engine(0);
+        std::uniform_int_distribution<std::size_t> length(
+            1, static_cast<std::size_t>(state.range(0)));
+        std::uniform_int_distribution<std::size_t> slot(0, 1023);
+
+        std::vector<std::pair<int *, std::size_t>> arrays(1024);
+        for (auto &array : arrays) {
+            array.second = length(engine);
+            array.first = allocator.allocate(array.second);
+        }
+        for (auto _ : state) {
+            auto &array = arrays[slot(engine)];
+            allocator.deallocate(array.first, array.second);
+            array.second = length(engine);
+            array.first = allocator.allocate(array.second);
+        }
+        for (auto &array : arrays) {
+            allocator.deallocate(array.first, array.second);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// every thread allocates 256 objects of one allocator and frees them
+    template <class Context> void threads(benchmark::State &state) {
+        static std::unique_ptr<Context> context;
+        if (state.thread_index() == 0)
+            context.reset(new Context());
+
+        std::vector<int *> pointers(256);
+        for (auto _ : state) {
+            auto &allocator = context->allocator;
+            for (auto &ptr : pointers) {
+                ptr = allocator.allocate(1);
+            }
+            for (auto ptr : pointers) {
+                allocator.deallocate(ptr, 1);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * pointers.size());
+
+        if (state.thread_index() == 0)
+            context.reset();
+    }
+
+    /// producer allocates batches of 100 objects and consumer thread frees them
+    template <class Context> void pipeline(benchmark::State &state) {
+        constexpr std::size_t kBatchCount = 1000;
+        constexpr std::size_t kBatchSize = 100;
+        Context context;
+        auto &allocator = context.allocator;
+
+        for (auto _ : state) {
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::deque<std::vector<int *>> batches;
+
+            std::thread consumer([&] {
+                for (std::size_t bi = 0; bi < kBatchCount; ++bi) {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    condition.wait(lock, [&batches] { return !batches.empty(); });
+                    auto batch = std::move(batches.front());
+                    batches.pop_front();
+                    lock.unlock();
+
+                    for (auto ptr : batch) {
+                        allocator.deallocate(ptr, 1);
+                    }
+                }
+            });
+
+            for (std::size_t bi = 0; bi < kBatchCount; ++bi) {
+                std::vector<int *> batch(kBatchSize);
+                for (auto &ptr : batch) {
+                    ptr = allocator.allocate(1);
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                batches.push_back(std::move(batch));
+                condition.notify_one();
+            }
+            consumer.join();
+        }
+        state.SetItemsProcessed(state.iterations() * kBatchCount * kBatchSize);
+    }
+
+    /// allocate and free arrays of range(0) objects in a chunk whose free area is fragmented
+    template <class Context> void fragmentedSearch(benchmark::State &state) {
+        constexpr auto kObjectCount = Context::allocator_type::AllocatorSubsystemType::
+            kAllocatableObjectCount;
+        const auto length = static_cast<std::size_t>(state.range(0));
+        Context context;
+        auto &allocator = context.allocator;
+
+        std::vector<int *> pointers(kObjectCount - 1);
+        for (auto &ptr : pointers) {
+            ptr = allocator.allocate(1);
+        }
+        for (std::size_t i = 0; i < pointers.size(); ++i) {
+            if (i % 3 != 0 || i > 30)
+                allocator.deallocate(pointers[i], 1);
+        }
+
+        for (auto _ : state) {
+            allocator.deallocate(allocator.allocate(length), length);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// allocate range(0) objects from an empty allocator.
+    /// range(1) is the cap of chunks allocated at once, and range(2) is 1 to reserve objects.
+    template <class Context> void warmUp(benchmark::State &state) {
+        const auto count = static_cast<std::size_t>(state.range(0));
+        std::vector<int *> pointers(count);
+        for (auto _ : state) {
+            typename Context::allocator_type allocator(1,
+                                                       static_cast<std::size_t>(state.range(1)));
+            if (state.range(2) != 0)
+                allocator.reserve(count);
+            for (auto &ptr : pointers) {
+                ptr = allocator.allocate(1);
+            }
+
+            state.PauseTiming();
+            for (auto ptr : pointers) {
+                allocator.deallocate(ptr, 1);
+            }
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+
+    /// allocate range(0) objects and free them.
+    /// range(1) is 1 to use allocate_bulk and deallocate_bulk, 0 to loop over objects.
+    /// range(2) is 1 to free objects in random order.
+    template <class Context> void bulk(benchmark::State &state) {
+        const auto count = static_cast<std::size_t>(state.range(0));
+        const bool useBulk = state.range(1) != 0;
+        const auto order = permutation(count);
+        Context context;
+        auto &allocator = context.allocator;
+        std::vector<int *> pointers(count);
+        std::vector<int *> freed(count);
+        for (auto _ : state) {
+            if (useBulk) {
+                allocator.allocate_bulk(pointers.data(), count);
+            } else {
+                for (auto &ptr : pointers) {
+                    ptr = allocator.allocate(1);
+                }
+            }
+
+            for (std::size_t i = 0; i < count; ++i) {
+                freed[i] = pointers[state.range(2) != 0 ? order[i] : i];
+            }
+            if (useBulk) {
+                allocator.deallocate_bulk(freed.data(), count);
+            } else {
+                for (auto ptr : freed) {
+                    allocator.deallocate(ptr, 1);
+                }
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+
+    /// free every object of a request one by one
+    template <class Allocator>
+    void releaseRequest(Allocator &allocator, const std::vector<int *> &pointers) {
+        for (auto ptr : pointers) {
+            allocator.deallocate(ptr, 1);
+        }
+    }
+
+    /// free every object of a request at once
+    template <class Upstream, std::size_t N>
+    void releaseRequest(
+        black::BlockAllocator<int, subsystems::MonotonicAllocationSubsystem<int, N>, Upstream>
+            &allocator,
+        const std::vector<int *> &) {
+        allocator.reset();
+    }
+
+    /// allocate range(0) objects per request and free them at the end of the request
+    template <class Context> void requests(benchmark::State &state) {
+        Context context;
+        auto &allocator = context.allocator;
+        std::vector<int *> pointers(static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state) {
+            for (auto &ptr : pointers) {
+                ptr = allocator.allocate(1);
+            }
+            releaseRequest(allocator, pointers);
+        }
+        state.SetItemsProcessed(state.iterations() * pointers.size());
+    }
+
+    /// traverse a sorted std::list of range(0) random values,
+    /// so nodes are visited in random address order and every visit is likely a cache miss
+    template <class Context> void randomTraversal(benchmark::State &state) {
+        const auto count = static_cast<std::size_t>(state.range(0));
+        Context context;
+        auto ls = context.template make<List<Context>>();
+        std::mt19937 engine(0);
+        for (std::size_t i = 0; i < count; ++i) {
+            ls.emplace_back(static_cast<int>(engine()));
+        }
+        ls.sort();
+
+        for (auto _ : state) {
+            long long sum = 0;
+            for (auto value : ls) {
+                sum += value;
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+
+    /// object of a cache line which links to the next object to visit
+    struct Link {
+        Link *next;
+        char payload[48];
+        long long value;
+    };
+
+    /// follow links of range(0) objects in random order, and read both ends of each object.
+    /// an object which is not placed at a cache line spans two lines, and costs two misses.
+    template <class Context> void pointerChase(benchmark::State &state) {
+        const auto count = static_cast<std::size_t>(state.range(0));
+        Rebind<Context, Link> allocator;
+        std::vector<Link *> links(count);
+        for (auto &link : links) {
+            link = allocator.allocate(1);
+        }
+        const auto order = permutation(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            links[order[i]]->next = links[order[(i + 1) % count]];
+            links[order[i]]->value = static_cast<long long>(i);
+        }
+
+        for (auto _ : state) {
+            auto link = links[order[0]];
+            long long sum = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                sum += link->value;
+                link = link->next;
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        for (auto link : links) {
+            allocator.deallocate(link, 1);
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+    }
+
+    /// traverse a singly linked list of range(0) nodes.
+    /// nodes are linked in allocation order if range(1) is 0, and in random order otherwise.
+    template <class Allocator> void listTraversal(benchmark::State &state) {
+        using Node = typename Allocator::value_type;
+        using Pointer = typename std::allocator_traits<Allocator>::pointer;
+
+        const auto count = static_cast<std::size_t>(state.range(0));
+        Allocator allocator;
+        std::vector<Pointer> nodes(count);
+        for (auto &node : nodes) {
+            node = allocator.allocate(1);
+        }
+        auto order = permutation(count);
+        if (state.range(1) == 0)
+            std::sort(order.begin(), order.end());
+        for (std::size_t i = 0; i < count; ++i) {
+            nodes[order[i]]->next = i + 1 < count ? nodes[order[i + 1]] : nullptr;
+            nodes[order[i]]->value = static_cast<int>(i);
+        }
+
+        for (auto _ : state) {
+            long long sum = 0;
+            for (auto node = nodes[order[0]]; node != nullptr; node = node->next) {
+                sum += node->value;
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        for (auto node : nodes) {
+            allocator.deallocate(node, 1);
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+        state.counters["node_bytes"] = sizeof(Node);
+    }
+
+    /// object of Size bytes
+    template <std::size_t Size> struct Sized {
+        char bytes[Size];
+    };
+
+    /// \return bytes of chunks held by the allocator
+    template <class Allocator> std::size_t chunkBytes(const Allocator &allocator) {
+        return allocator.chunkCount() * Allocator::kChunkSize;
+    }
+
+    /// \return 0 since std::allocator has no chunks
+    template <class T> std::size_t chunkBytes(const std::allocator<T> &) { return 0; }
+
+    /// \return ratio of object bytes to bytes of a full chunk
+    template <class Allocator> double chunkEfficiency(const Allocator &) {
+        return static_cast<double>(Allocator::AllocatorSubsystemType::kAllocatableObjectCount *
+                                   sizeof(typename Allocator::value_type)) /
+               Allocator::kChunkSize;
+    }
+
+    template <class T> double chunkEfficiency(const std::allocator<T> &) { return 0; }
+
+    /// allocate range(0) objects of Size bytes, write them and free them in random order.
+    /// chunk_efficiency is the ratio of object bytes to bytes of a full chunk, and efficiency is
+    /// the ratio to bytes of all chunks, batches included, while all objects are live.
+    template <class Context, std::size_t Size> void objectSizes(benchmark::State &state) {
+        using T = Sized<Size>;
+        const auto count = static_cast<std::size_t>(state.range(0));
+        Rebind<Context, T> allocator;
+        std::vector<T *> pointers(count);
+        const auto order = permutation(count);
+        std::size_t bytes = 0;
+
+        for (auto _ : state) {
+            for (auto &pointer : pointers) {
+                pointer = allocator.allocate(1);
+                pointer->bytes[0] = 1;
+            }
+            bytes = chunkBytes(allocator);
+            for (auto i : order) {
+                allocator.deallocate(pointers[i], 1);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * count);
+        if (bytes != 0) {
+            state.counters["chunk_efficiency"] = chunkEfficiency(allocator);
+            state.counters["efficiency"] = static_cast<double>(count * sizeof(T)) / bytes;
+        }
+    }
+
+    /// keep 10000 objects of random sizes up to range(0) bytes, and replace a random one
+    template <class Context> void mixedSizes(benchmark::State &state) {
+        constexpr std::size_t kLiveCount = 10000;
+        Context context;
+        auto &resource = context.resource;
+        std::mt19937 engine(0);
+        const auto maxBytes = static_cast<std::size_t>(state.range(0));
+        std::uniform_int_distribution<std::size_t> size(1, maxBytes);
+        std::uniform_int_distribution<std::size_t> slot(0, kLiveCount - 1);
+
+        std::vector<std::pair<void *, std::size_t>> objects(kLiveCount);
+        for (auto &object : objects) {
+            object.second = size(engine);
+            object.first = resource.allocate(object.second);
+        }
+        for (auto _ : state) {
+            auto &object = objects[slot(engine)];
+            resource.deallocate(object.first, object.second);
+            object.second = size(engine);
+            object.first = resource.allocate(object.second);
+        }
+        for (auto &object : objects) {
+            resource.deallocate(object.first, object.second);
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// object of the factory benchmarks
+    struct Widget {
+        explicit Widget(long long v) : value(v), payload() {}
+
+        long long value;
+        char payload[40];
+    };
+
+    struct StdUnique {
+        std::unique_ptr<Widget> make(long long value) { return std::make_unique<Widget>(value); }
+    };
+
+    struct StdShared {
+        std::shared_ptr<Widget> make(long long value) { return std::make_shared<Widget>(value); }
+    };
+
+    struct PoolUnique {
+        black::ObjectPool<Widget> pool;
+
+        black::ObjectPool<Widget>::UniquePointer make(long long value) {
+            return pool.make_unique(value);
+        }
+    };
+
+    struct PoolShared {
+        black::ObjectPool<Widget> pool;
+
+        std::shared_ptr<Widget> make(long long value) { return pool.make_shared(value); }
+    };
+
+    /// keep range(0) objects of a factory, and replace a random one repeatedly
+    template <class Factory> void factoryChurn(benchmark::State &state) {
+        const auto count = static_cast<std::size_t>(state.range(0));
+        Factory factory;
+        std::vector<decltype(factory.make(0))> objects;
+        for (std::size_t i = 0; i < count; ++i) {
+            objects.push_back(factory.make(static_cast<long long>(i)));
+        }
+
+        std::mt19937 engine(0);
+        std::uniform_int_distribution<std::size_t> slot(0, count - 1);
+        std::vector<std::size_t> slots(1 << 16);
+        for (auto &index : slots) {
+            index = slot(engine);
+        }
+
+        std::size_t step = 0;
+        for (auto _ : state) {
+            auto &object = objects[slots[step++ % slots.size()]];
+            object.reset();
+            object = factory.make(static_cast<long long>(step));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+
+    /// new_delete_resource does not pool areas
+    struct NewDelete {
+        std::pmr::memory_resource &resource = *std::pmr::new_delete_resource();
+    };
+
+    /// every thread mallocs 256 areas of random small sizes and frees them.
+    /// run with and without LD_PRELOAD=libblack-preload.so to compare with glibc malloc
+    void mallocThreads(benchmark::State &state) {
+        std::mt19937 engine(static_cast<std::mt19937::result_type>(state.thread_index()));
+        std::uniform_int_distribution<std::size_t> size(1, 256);
+        std::vector<std::size_t> sizes(256);
+        for (auto &length : sizes) {
+            length = size(engine);
+        }
+
+        std::vector<void *> pointers(sizes.size());
+        for (auto _ : state) {
+            for (std::size_t i = 0; i < sizes.size(); ++i) {
+                pointers[i] = std::malloc(sizes[i]);
+            }
+            for (auto ptr : pointers) {
+                std::free(ptr);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * sizes.size());
+    }
+} // namespace
+
+#define BLACK_CONTAINER_BENCHMARK(name, context)                                                   \
+    BENCHMARK_TEMPLATE(name, context)->Arg(1000)->Arg(100000)
+
+BLACK_CONTAINER_BENCHMARK(listLifetime, Std);
+BLACK_CONTAINER_BENCHMARK(listLifetime, PmrPool);
+BLACK_CONTAINER_BENCHMARK(listLifetime, Bit);
+BLACK_CONTAINER_BENCHMARK(listLifetime, LinkedList);
+BLACK_CONTAINER_BENCHMARK(listLifetime, Hierarchical);
+
+BLACK_CONTAINER_BENCHMARK(forwardListLifetime, Std);
+BLACK_CONTAINER_BENCHMARK(forwardListLifetime, PmrPool);
+BLACK_CONTAINER_BENCHMARK(forwardListLifetime, Bit);
+BLACK_CONTAINER_BENCHMARK(forwardListLifetime, LinkedList);
+BLACK_CONTAINER_BENCHMARK(forwardListLifetime, Hierarchical);
+
+BLACK_CONTAINER_BENCHMARK(mapLifetime, Std);
+BLACK_CONTAINER_BENCHMARK(mapLifetime, PmrPool);
+BLACK_CONTAINER_BENCHMARK(mapLifetime, Shared);
+BLACK_CONTAINER_BENCHMARK(mapLifetime, BlackPool);
+
+#undef BLACK_CONTAINER_BENCHMARK
+
+// 1M objects for large pools
+#define BLACK_RANDOM_ORDER_BENCHMARK(context)                                                      \
+    BENCHMARK_TEMPLATE(randomOrderFree, context)->Arg(4096)->Arg(1 << 20)
+
+BLACK_RANDOM_ORDER_BENCHMARK(Std);
+BLACK_RANDOM_ORDER_BENCHMARK(PmrPool);
+BLACK_RANDOM_ORDER_BENCHMARK(Bit);
+BLACK_RANDOM_ORDER_BENCHMARK(LinkedList);
+BLACK_RANDOM_ORDER_BENCHMARK(Hierarchical);
+
+#undef BLACK_RANDOM_ORDER_BENCHMARK
+
+// 1 to 100k chunks of kAllocatableObjectCount objects
+BENCHMARK_TEMPLATE(chunkFree, Bit)->RangeMultiplier(10)->Range(1, 100000);
+BENCHMARK_TEMPLATE(chunkFree, LinkedList)->RangeMultiplier(10)->Range(1, 100000);
+
+// pool size and occupancy percentage
+#define BLACK_CHURN_BENCHMARK(context)                                                             \
+    BENCHMARK_TEMPLATE(churn, context)->ArgsProduct({{1 << 16, 1 << 20}, {10, 50, 90}})
+
+BLACK_CHURN_BENCHMARK(Std);
+BLACK_CHURN_BENCHMARK(PmrPool);
+BLACK_CHURN_BENCHMARK(Bit);
+BLACK_CHURN_BENCHMARK(LinkedList);
+BLACK_CHURN_BENCHMARK(Hierarchical);
+
+#undef BLACK_CHURN_BENCHMARK
+
+#define BLACK_ARRAY_BENCHMARK(context)                                                             \
+    BENCHMARK_TEMPLATE(arrays, context)->RangeMultiplier(2)->Range(1, 64)
+
+BLACK_ARRAY_BENCHMARK(Std);
+BLACK_ARRAY_BENCHMARK(PmrPool);
+BLACK_ARRAY_BENCHMARK(Bit);
+BLACK_ARRAY_BENCHMARK(LinkedList);
+BLACK_ARRAY_BENCHMARK(Hierarchical);
+
+#undef BLACK_ARRAY_BENCHMARK
+
+#define BLACK_MIXED_ARRAY_BENCHMARK(context)                                                       \
+    BENCHMARK_TEMPLATE(mixedArrays, context)->Arg(64)->Arg(1024)
+
+BLACK_MIXED_ARRAY_BENCHMARK(Std);
+BLACK_MIXED_ARRAY_BENCHMARK(PmrPool);
+BLACK_MIXED_ARRAY_BENCHMARK(Bit);
+BLACK_MIXED_ARRAY_BENCHMARK(Hierarchical);
+BLACK_MIXED_ARRAY_BENCHMARK(Shared);
+
+#undef BLACK_MIXED_ARRAY_BENCHMARK
+
+#define BLACK_THREAD_BENCHMARK(context)                                                            \
+    BENCHMARK_TEMPLATE(threads, context)->ThreadRange(1, 8)->UseRealTime()
+
+BLACK_THREAD_BENCHMARK(Std);
+BLACK_THREAD_BENCHMARK(PmrSynchronizedPool);
+BLACK_THREAD_BENCHMARK(Concurrent);
+BLACK_THREAD_BENCHMARK(Atomic);
+
+#undef BLACK_THREAD_BENCHMARK
+
+BENCHMARK(mallocThreads)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_TEMPLATE(pipeline, Std)->UseRealTime();
+BENCHMARK_TEMPLATE(pipeline, Concurrent)->UseRealTime();
+BENCHMARK_TEMPLATE(pipeline, Atomic)->UseRealTime();
+
+BENCHMARK_TEMPLATE(fragmentedSearch, Bit)->Arg(1)->Arg(5)->Arg(32);
+BENCHMARK_TEMPLATE(fragmentedSearch, LinkedList)->Arg(1)->Arg(5)->Arg(32);
+
+// one chunk at once, batches, and reserve
+BENCHMARK_TEMPLATE(warmUp, Bit)->ArgsProduct({{1000, 1000000}, {1}, {0}});
+BENCHMARK_TEMPLATE(warmUp, Bit)->ArgsProduct({{1000, 1000000}, {64}, {0, 1}});
+
+// object count, bulk or per-object loop, sequential or random order of frees
+BENCHMARK_TEMPLATE(bulk, Bit)->ArgsProduct({{100, 10000}, {0, 1}, {0, 1}});
+BENCHMARK_TEMPLATE(bulk, Hierarchical)->ArgsProduct({{100, 10000}, {0, 1}, {0, 1}});
+
+BENCHMARK_TEMPLATE(requests, Bit)->Arg(100)->Arg(10000);
+BENCHMARK_TEMPLATE(requests, Hierarchical)->Arg(100)->Arg(10000);
+BENCHMARK_TEMPLATE(requests, Arena)->Arg(100)->Arg(10000);
+
+// upstream of chunks
+BENCHMARK_TEMPLATE(randomTraversal, Std)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(randomTraversal, Hierarchical)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(randomTraversal, Mmap)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(randomTraversal, HugePage)->Arg(1 << 20);
+
+// links of pointers and handles
+BENCHMARK_TEMPLATE(listTraversal, PointerNodeAllocator)->Args({10000000, 0})->Args({10000000, 1});
+BENCHMARK_TEMPLATE(listTraversal, HandleNodeAllocator)->Args({10000000, 0})->Args({10000000, 1});
+
+// chunk layouts
+BENCHMARK_TEMPLATE(pointerChase, Std)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(pointerChase, Bit)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(pointerChase, BitCacheLine)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(pointerChase, Hierarchical)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(pointerChase, HierarchicalCacheLine)->Arg(1 << 16)->Arg(1 << 20);
+
+// chunk geometry of each object size
+#define BLACK_OBJECT_SIZE_BENCHMARK(context)                                                       \
+    BENCHMARK_TEMPLATE(objectSizes, context, 8)->Arg(1 << 16);                                     \
+    BENCHMARK_TEMPLATE(objectSizes, context, 24)->Arg(1 << 16);                                    \
+    BENCHMARK_TEMPLATE(objectSizes, context, 64)->Arg(1 << 16);                                    \
+    BENCHMARK_TEMPLATE(objectSizes, context, 200)->Arg(1 << 16);                                   \
+    BENCHMARK_TEMPLATE(objectSizes, context, 1000)->Arg(1 << 16);                                  \
+    BENCHMARK_TEMPLATE(objectSizes, context, 4096)->Arg(1 << 16)
+
+BLACK_OBJECT_SIZE_BENCHMARK(Std);
+BLACK_OBJECT_SIZE_BENCHMARK(Bit);
+BLACK_OBJECT_SIZE_BENCHMARK(Hierarchical);
+BLACK_OBJECT_SIZE_BENCHMARK(HierarchicalAuto);
+
+#undef BLACK_OBJECT_SIZE_BENCHMARK
+
+// owners of individual objects
+BENCHMARK_TEMPLATE(factoryChurn, StdUnique)->Arg(1000)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(factoryChurn, PoolUnique)->Arg(1000)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(factoryChurn, StdShared)->Arg(1000)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(factoryChurn, PoolShared)->Arg(1000)->Arg(1 << 20);
+
+BENCHMARK_TEMPLATE(mixedSizes, NewDelete)->Arg(64)->Arg(512);
+BENCHMARK_TEMPLATE(mixedSizes, PmrPool)->Arg(64)->Arg(512);
+BENCHMARK_TEMPLATE(mixedSizes, BlackPool)->Arg(64)->Arg(512);
+
+BENCHMARK_MAIN();
@@ -14,10 +14,34 @@
 
 #pragma once
 
+#include <atomic>
 #include <bitset>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define BLACK_HAS_MMAP 1
+#endif
+
+#if defined(__has_include) && __cplusplus >= 201703L
+#if __has_include(<memory_resource>)
+#include <array>
+#include <memory_resource>
+#include <tuple>
+#define BLACK_HAS_MEMORY_RESOURCE 1
+#endif
+#endif
 
 #ifndef likely
 #define _likely_black_defined 1
@@ -30,33 +54,385 @@
 #endif
 
 namespace black {
+    namespace detail {
+        /// count trailing zero bits
+        /// \param bits non-zero value
+        inline unsigned countTrailingZeros(std::uint64_t bits) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+            unsigned count = 0;
+            for (; (bits & 1u) == 0; bits >>= 1u) {
+                ++count;
+            }
+            return count;
+#endif
+        }
+
+        /// count leading zero bits
+        /// \param bits non-zero value
+        inline unsigned countLeadingZeros(std::uint64_t bits) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_clzll(bits));
+#else
+            unsigned count = 0;
+            for (; (bits & (std::uint64_t(1) << 63u)) == 0; bits <<= 1u) {
+                ++count;
+            }
+            return count;
+#endif
+        }
+
+        /// count set bits
+        inline unsigned popCount(std::uint64_t bits) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_popcountll(bits));
+#else
+            unsigned count = 0;
+            for (; bits != 0; bits &= bits - 1) {
+                ++count;
+            }
+            return count;
+#endif
+        }
+
+        /// bitmask whose lower n bits are set
+        /// \param n bit count (0 to 64)
+        constexpr std::uint64_t lowerBits(std::size_t n) noexcept {
+            return n >= 64 ? ~std::uint64_t() : (std::uint64_t(1) << n) - 1;
+        }
+
+        /// \return the lowest count set bits of bits
+        inline std::uint64_t lowestSetBits(std::uint64_t bits, std::size_t count) noexcept {
+            std::uint64_t taken = 0;
+            for (; bits != 0 && count > 0; --count) {
+                taken |= bits & (~bits + 1);
+                bits &= bits - 1;
+            }
+            return taken;
+        }
+
+        /// store pointers to the blocks of the set bits
+        /// \return pointer next to the last stored pointer
+        template <class T, class Bucket>
+        T **storeBlocks(T **out, Bucket *first, std::uint64_t bits) noexcept {
+            for (; bits != 0; bits &= bits - 1) {
+                *out++ = reinterpret_cast<T *>(first + countTrailingZeros(bits));
+            }
+            return out;
+        }
+
+        /// search the lowest run of n zero bits
+        /// \param usedBits bitmap whose set bits are used blocks
+        /// \param n run length (1 to 64)
+        /// \return index of the run head. 64 if no run is found
+        inline unsigned findFreeRun(std::uint64_t usedBits, std::size_t n) noexcept {
+            // bit i of candidates stays set while blocks i to i + length - 1 are free
+            auto candidates = ~usedBits;
+            for (std::size_t length = 1; length < n && candidates != 0;) {
+                const auto shift = length < n - length ? length : n - length;
+                candidates &= candidates >> shift;
+                length += shift;
+            }
+            return candidates == 0 ? 64 : countTrailingZeros(candidates);
+        }
+
+        /// link node to the head of the list of nodes which have free area
+        /// \tparam Node node type which has prevAvailable, nextAvailable and available
+        template <class Node> void linkAvailable(Node *&head, Node *node) noexcept {
+            node->available = true;
+            node->prevAvailable = nullptr;
+            node->nextAvailable = head;
+            if (head != nullptr)
+                head->prevAvailable = node;
+            head = node;
+        }
+
+        /// unlink node from the list of nodes which have free area
+        /// \tparam Node node type which has prevAvailable, nextAvailable and available
+        template <class Node> void unlinkAvailable(Node *&head, Node *node) noexcept {
+            node->available = false;
+            if (node->prevAvailable != nullptr)
+                node->prevAvailable->nextAvailable = node->nextAvailable;
+            else
+                head = node->nextAvailable;
+            if (node->nextAvailable != nullptr)
+                node->nextAvailable->prevAvailable = node->prevAvailable;
+        }
+
+        /// \return node which contains ptr
+        /// \tparam Node node type placed at a multiple of Alignment
+        template <class Node, std::size_t Alignment>
+        Node *alignedOwnerOf(const void *ptr) noexcept {
+            return reinterpret_cast<Node *>(reinterpret_cast<std::uintptr_t>(ptr) &
+                                            ~(Alignment - 1));
+        }
+
+        /// true if Subsystem::kThreadSafe is true
+        template <class Subsystem, class = void> struct IsThreadSafeSubsystem : std::false_type {};
+        template <class Subsystem>
+        struct IsThreadSafeSubsystem<Subsystem,
+                                     typename std::enable_if<Subsystem::kThreadSafe>::type>
+            : std::true_type {};
+
+        /// true if Subsystem::kMonotonic is true
+        template <class Subsystem, class = void> struct IsMonotonicSubsystem : std::false_type {};
+        template <class Subsystem>
+        struct IsMonotonicSubsystem<Subsystem, typename std::enable_if<Subsystem::kMonotonic>::type>
+            : std::true_type {};
+
+        /// true if Subsystem has allocate_bulk and deallocate_bulk
+        template <class Subsystem, class = void> struct HasBulkAllocation : std::false_type {};
+        template <class Subsystem>
+        struct HasBulkAllocation<
+            Subsystem,
+            decltype(void(std::declval<Subsystem &>().allocate_bulk(nullptr, 0)),
+                     void(std::declval<Subsystem &>().deallocate_bulk(nullptr, 0)))>
+            : std::true_type {};
+
+        /// \return byte count of n objects
+        /// \tparam T object type
+        /// \throw std::bad_alloc if the byte count overflows
+        template <class T> std::size_t arrayBytes(std::size_t n) {
+            if (n > ~std::size_t() / sizeof(T))
+                throw std::bad_alloc();
+            return n * sizeof(T);
+        }
+
+        /// \return bit count to represent n
+        constexpr std::size_t bitWidth(std::size_t n) noexcept {
+            return n == 0 ? 0 : 1 + bitWidth(n >> 1u);
+        }
+
+        /// smallest power of two which is not less than n
+        constexpr std::size_t ceilPowerOfTwo(std::size_t n, std::size_t candidate = 1) noexcept {
+            return candidate >= n ? candidate : ceilPowerOfTwo(n, candidate << 1u);
+        }
+
+        /// \return address unique to Key
+        template <class Key> const void *typeKey() noexcept {
+            static const char key = 0;
+            return &key;
+        }
+
+        /// \return index of the next type numbered by typeIndex
+        inline std::size_t nextTypeIndex() noexcept {
+            static std::atomic<std::size_t> next(0);
+            return next.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /// \return index unique to Key, numbered at the first use of Key
+        template <class Key> std::size_t typeIndex() noexcept {
+            static const std::size_t index = nextTypeIndex();
+            return index;
+        }
+
+        /// pools of each type shared by allocator handles
+        class PoolRegistry {
+        public:
+            /// pool types found without the lock. other types are looked up under the lock
+            static constexpr std::size_t kSlotCount = 64;
+
+        private:
+            struct Entry {
+                const void *key;
+                std::shared_ptr<void> pool;
+            };
+
+        private:
+            /// pool of each type index. set once under the lock
+            std::atomic<void *> _slots[kSlotCount];
+            std::mutex _mutex;
+            std::vector<Entry> _entries;
+
+        public:
+            PoolRegistry() noexcept
+                : _slots() {}
+
+            /// \tparam Pool pool type. default constructed at first use
+            /// \return pool of the type
+            template <class Pool> Pool *get() {
+                const auto index = typeIndex<Pool>();
+                if (likely(index < kSlotCount)) {
+                    if (auto pool = _slots[index].load(std::memory_order_acquire))
+                        return static_cast<Pool *>(pool);
+                }
+
+                const auto key = typeKey<Pool>();
+                std::lock_guard<std::mutex> lock(_mutex);
+                for (const auto &entry : _entries) {
+                    if (entry.key == key)
+                        return static_cast<Pool *>(entry.pool.get());
+                }
+                auto pool = std::make_shared<Pool>();
+                _entries.push_back({key, pool});
+                if (index < kSlotCount)
+                    _slots[index].store(pool.get(), std::memory_order_release);
+                return pool.get();
+            }
+        };
+    } // namespace detail
+
+    /// Chunk layouts
+    /// A layout decides where the objects of a chunk start.
+    /// The chunk metadata (links of the chunk and the state of its subsystem) precedes the objects,
+    /// and the padding between them is decided by the layout.
+    /// The metadata is not moved to a separate array,
+    /// because the chunk owning an object is found by masking the object address.
+    namespace layouts {
+        /// objects follow the metadata without padding. least memory
+        struct Packed {
+            static constexpr std::size_t kAlignment = 1;
+        };
+
+        /// objects start at a cache line, so no object shares a cache line with the metadata.
+        /// writes to the metadata do not evict objects, and do not false-share with other threads.
+        struct CacheLine {
+            static constexpr std::size_t kAlignment = 64;
+        };
+
+        /// objects start at a page.
+        /// chunks grow to a multiple of the page size, and are placed at a power of two,
+        /// so choose an object count whose objects and metadata fit a power of two pages.
+        struct Page {
+            static constexpr std::size_t kAlignment = 4096;
+        };
+    } // namespace layouts
+
+    /// Chunk geometry
+    /// A chunk is placed at the smallest power of two not less than its size,
+    /// so a chunk wastes little if its objects and metadata nearly fill the power of two.
+    /// A geometry decides the objects of a chunk from the object size, the cache line and the page.
+    namespace geometry {
+        constexpr std::size_t kCacheLineSize = 64;
+        constexpr std::size_t kPageSize = 4096;
+        /// bytes reserved for the links of a chunk kept by the allocator
+        constexpr std::size_t kHeaderSize = 2 * kCacheLineSize;
+        /// objects of a chunk at least, unless the subsystem holds fewer
+        constexpr std::size_t kMinObjectCount = 8;
+        /// object count of a subsystem which follows the ChunkGeometry of the object type
+        constexpr std::size_t kAuto = 0;
+
+        /// \return bytes of a block. size rounded up to alignment
+        constexpr std::size_t blockSize(std::size_t size, std::size_t alignment) noexcept {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        /// \return bytes of a chunk of kMinObjectCount blocks, at least a page
+        constexpr std::size_t defaultChunkSize(std::size_t blockSize) noexcept {
+            return detail::ceilPowerOfTwo(kMinObjectCount * blockSize + kHeaderSize > kPageSize
+                                              ? kMinObjectCount * blockSize + kHeaderSize
+                                              : kPageSize);
+        }
+
+        /// geometry which fits chunks of T in ChunkSize bytes
+        /// \tparam T object type
+        /// \tparam ChunkSize bytes of a chunk. a power of two
+        template <class T, std::size_t ChunkSize> struct Fit {
+            static constexpr std::size_t kBlockSize = blockSize(sizeof(T), alignof(T));
+            static constexpr std::size_t kChunkSize = ChunkSize;
+
+            static_assert((ChunkSize & (ChunkSize - 1)) == 0, "ChunkSize must be a power of two");
+
+            /// \return bytes of a chunk besides the metadata of each object
+            static constexpr std::size_t fixedSize(std::size_t metadataSize,
+                                                   std::size_t alignment) noexcept {
+                // padding before the subsystem, before the objects and at the end
+                return kHeaderSize + metadataSize + 3 * alignment;
+            }
+
+            /// \return objects which fit chunkSize bytes
+            static constexpr std::size_t fit(std::size_t chunkSize, std::size_t metadataBits,
+                                             std::size_t fixed) noexcept {
+                return chunkSize <= fixed
+                           ? 0
+                           : (chunkSize - fixed) * 8 / (kBlockSize * 8 + metadataBits);
+            }
+
+            /// \return bytes of a chunk of n objects
+            static constexpr std::size_t sizeOf(std::size_t n, std::size_t metadataBits,
+                                                std::size_t fixed) noexcept {
+                return fixed + (n * (kBlockSize * 8 + metadataBits) + 7) / 8;
+            }
+
+            /// \return n, or the objects of a chunk of half the size if they waste less
+            static constexpr std::size_t lessWaste(std::size_t n, std::size_t halfCount) noexcept {
+                return halfCount * 2 > n ? halfCount : n;
+            }
+
+            static constexpr std::size_t countOf(std::size_t n, std::size_t metadataBits,
+                                                 std::size_t fixed) noexcept {
+                return n == 0 ? 1
+                              : lessWaste(n, fit(detail::ceilPowerOfTwo(
+                                                     sizeOf(n, metadataBits, fixed)) /
+                                                     2,
+                                                 metadataBits, fixed));
+            }
+
+            /// \param metadataBits metadata bits of each object in the subsystem
+            /// \param metadataSize other metadata bytes of the subsystem
+            /// \param maxCount objects which the subsystem can hold at most
+            /// \param alignment alignment of the objects in the chunk
+            /// \return objects of a chunk. at least 1
+            static constexpr std::size_t objectCount(std::size_t metadataBits,
+                                                     std::size_t metadataSize,
+                                                     std::size_t maxCount,
+                                                     std::size_t alignment) noexcept {
+                return countOf(
+                    fit(ChunkSize, metadataBits, fixedSize(metadataSize, alignment)) < maxCount
+                        ? fit(ChunkSize, metadataBits, fixedSize(metadataSize, alignment))
+                        : maxCount,
+                    metadataBits, fixedSize(metadataSize, alignment));
+            }
+        };
+    } // namespace geometry
+
+    /// Chunk geometry of T
+    /// Subsystems whose object count is geometry::kAuto follow it.
+    /// Specialize it to tune the chunks of a type, e.g.
+    ///   template <> struct black::ChunkGeometry<Node> : black::geometry::Fit<Node, 65536> {};
+    /// \tparam T object type
+    template <class T>
+    struct ChunkGeometry
+        : geometry::Fit<T, geometry::defaultChunkSize(geometry::blockSize(sizeof(T), alignof(T)))> {
+    };
+
     namespace subsystems {
         namespace detail {
-            template <std::size_t ObjectSize, std::size_t CurrentSize, std::size_t Align>
-            struct BlockSizeImpl {
+            /// alignment of the objects of a chunk
+            /// \tparam T object type
+            /// \tparam Layout chunk layout
+            template <class T, class Layout> struct BucketAlignment {
                 static constexpr std::size_t value =
-                    BlockSizeImpl<ObjectSize, CurrentSize + Align, Align>::value;
-            };
-            template <std::size_t Size, std::size_t Align> struct BlockSizeImpl<Size, Size, Align> {
-                static constexpr std::size_t value = Size;
-            };
-
-            template <std::size_t Size, std::size_t Align> struct BlockSize {
-                static constexpr std::size_t value = BlockSizeImpl<Size, Align, Align>::value;
+                    Layout::kAlignment > alignof(T) ? Layout::kAlignment : alignof(T);
             };
         } // namespace detail
 
-        template <class T, std::size_t ObjectCount> class LinkedListAllocationSubsystem {
+        /// Block allocator subsystem
+        /// This subsystem keeps runs of free blocks (extents) in linked lists indexed by length.
+        /// Both ends of a free extent hold its length (boundary tags), so freed blocks are
+        /// merged with neighboring extents in O(1).
+        /// \tparam T object type
+        /// \tparam ObjectCount allocatable object count. geometry::kAuto follows ChunkGeometry<T>
+        /// \tparam Layout chunk layout
+        template <class T, std::size_t ObjectCount = geometry::kAuto,
+                  class Layout = layouts::Packed>
+        class LinkedListAllocationSubsystem {
         public:
-            static constexpr std::size_t kBlockSize =
-                detail::BlockSize<sizeof(T), alignof(T)>::value;
-            static constexpr std::size_t kAllocatableObjectCount = ObjectCount;
+            static constexpr std::size_t kBlockSize = geometry::blockSize(sizeof(T), alignof(T));
+            static constexpr std::size_t kBucketAlignment =
+                detail::BucketAlignment<T, Layout>::value;
+            /// boundary tags and free lists take 65 bits of each block
+            static constexpr std::size_t kAllocatableObjectCount =
+                ObjectCount != geometry::kAuto
+                    ? ObjectCount
+                    : ChunkGeometry<T>::objectCount(65, 40, 0xfffe, kBucketAlignment);
             static constexpr std::size_t kBucketSize = kAllocatableObjectCount * kBlockSize;
 
             using value_type = T;
 
             template <class U> struct rebind {
-                using other = LinkedListAllocationSubsystem<U, ObjectCount>;
+                using other = LinkedListAllocationSubsystem<U, ObjectCount, Layout>;
             };
 
         private:
@@ -64,29 +440,94 @@ namespace black {
                 char block[kBlockSize];
             };
 
+            /// block index
+            using Index = typename std::conditional<(kAllocatableObjectCount < 0xffff),
+                                                    std::uint16_t, std::uint32_t>::type;
+            static constexpr Index kNone = static_cast<Index>(~Index());
+
             struct Node {
-                Node *next;
+                /// next extent of the same length. valid in the head of a free extent
+                Index next;
+                /// previous extent of the same length. valid in the head of a free extent
+                Index prev;
+                /// extent length in the head and the tail of a free extent. 0 otherwise
+                Index length;
             };
 
+            /// words of the bitmap of non-empty lists
+            static constexpr std::size_t kLengthWordCount = (kAllocatableObjectCount + 64) / 64;
+
         private:
-            /// free list (forward linked list)
-            Node _freeList[kAllocatableObjectCount];
-            /// first free node
-            Node *_freeListTop;
+            Node _nodes[kAllocatableObjectCount];
+            /// first free extent of each length
+            Index _freeLists[kAllocatableObjectCount + 1];
+            /// bit i is set if _freeLists[i] is not empty
+            std::uint64_t _availableLengths[kLengthWordCount];
+            /// allocated object count
+            std::size_t _allocatedCount;
 
             /// bucket
-            typename std::aligned_storage<kBucketSize, alignof(T)>::type _bucket;
+            typename std::aligned_storage<kBucketSize, kBucketAlignment>::type _bucket;
             /// pointer to bucket top
             Bucket *_first;
 
+        private:
+            /// link a free extent and write its boundary tags
+            void link(std::size_t head, std::size_t length) noexcept {
+                _nodes[head].length = static_cast<Index>(length);
+                _nodes[head + length - 1].length = static_cast<Index>(length);
+
+                const auto next = _freeLists[length];
+                _nodes[head].prev = kNone;
+                _nodes[head].next = next;
+                if (next != kNone)
+                    _nodes[next].prev = static_cast<Index>(head);
+                _freeLists[length] = static_cast<Index>(head);
+                _availableLengths[length / 64] |= std::uint64_t(1) << (length % 64);
+            }
+
+            /// unlink a free extent and clear its boundary tags
+            void unlink(std::size_t head) noexcept {
+                const std::size_t length = _nodes[head].length;
+                const auto next = _nodes[head].next;
+                const auto prev = _nodes[head].prev;
+                if (prev != kNone) {
+                    _nodes[prev].next = next;
+                } else {
+                    _freeLists[length] = next;
+                    if (next == kNone)
+                        _availableLengths[length / 64] &= ~(std::uint64_t(1) << (length % 64));
+                }
+                if (next != kNone)
+                    _nodes[next].prev = prev;
+
+                _nodes[head].length = 0;
+                _nodes[head + length - 1].length = 0;
+            }
+
+            /// \return shortest length of free extents not shorter than n. 0 if none
+            std::size_t findLength(std::size_t n) const noexcept {
+                auto word = n / 64;
+                auto bits = _availableLengths[word] & ~black::detail::lowerBits(n % 64);
+                while (bits == 0) {
+                    if (++word == kLengthWordCount)
+                        return 0;
+                    bits = _availableLengths[word];
+                }
+                return word * 64 + black::detail::countTrailingZeros(bits);
+            }
+
         public:
             LinkedListAllocationSubsystem() noexcept
-                : _freeListTop(_freeList)
+                : _nodes()
+                , _availableLengths()
+                , _allocatedCount(0)
                 , _bucket()
                 , _first(reinterpret_cast<Bucket *>(&_bucket)) {
-                for (std::size_t i = 1; i < kAllocatableObjectCount; ++i) {
-                    _freeList[i - 1].next = _freeList + i;
+                for (auto &head : _freeLists) {
+                    head = kNone;
                 }
+                link(0, kAllocatableObjectCount);
             }
 
             LinkedListAllocationSubsystem(const LinkedListAllocationSubsystem &) = delete;
@@ -103,48 +544,43 @@ namespace black {
             /// \param n object count
             /// \return pointer to allocated area. nullptr if no more allocatable area
             T *allocate(std::size_t n) noexcept {
-                if (unlikely(_freeListTop == nullptr)) {
-                    // cannot allocate
+                if (unlikely(n == 0 || n > kAllocatableObjectCount))
+                    return nullptr;
+
+                const auto length = findLength(n);
+                if (unlikely(length == 0)) {
+                    // no continuous area
                     return nullptr;
                 }
 
-                auto prev = _freeListTop;      // previous free node
-                auto candidate = _freeListTop; // head of continuous free area
-                auto tail = _freeListTop;      // tail of continuous free area
-                std::size_t areaLength = 1;
+                // split the head of the extent off, and keep the rest
+                const std::size_t head = _freeLists[length];
+                unlink(head);
+                if (length != n)
+                    link(head + n, length - n);
 
-                while (areaLength < n) {
-                    if (unlikely(tail->next == nullptr))
-                        return nullptr;
+                _allocatedCount += n;
+                return reinterpret_cast<T *>(&_first[head]);
+            }
 
-                    if ((tail + 1) != tail->next) {
-                        // non continuous area
-                        prev = tail;
-                        candidate = tail->next;
-                        tail = candidate;
-                        areaLength = 1;
-                    } else {
-                        tail = tail->next;
-                        areaLength++;
-                    }
-                }
+            /// \return pointer to the first block
+            T *data() noexcept { return reinterpret_cast<T *>(_first); }
 
-                if (likely(candidate == _freeListTop)) {
-                    _freeListTop = tail->next;
-                } else {
-                    prev->next = tail->next;
-                }
+            /// \return true if no more allocatable area
+            bool full() const noexcept { return _allocatedCount == kAllocatableObjectCount; }
 
-                auto index = candidate - _freeList;
-                return reinterpret_cast<T *>(&_first[index]);
-            }
+            /// \return true if no object is allocated
+            bool empty() const noexcept { return _allocatedCount == 0; }
+
+            /// \return allocated object count
+            std::size_t size() const noexcept { return _allocatedCount; }
 
             bool inRange(const T *ptr) {
                 if (unlikely(ptr == nullptr))
                     return false;
                 auto index =
                     static_cast<std::size_t>(reinterpret_cast<const Bucket *>(ptr) - _first);
-                return 0 <= index && index < kAllocatableObjectCount;
+                return index < kAllocatableObjectCount;
             }
 
             /// deallocate area
@@ -154,132 +590,87 @@ namespace black {
                 if (!inRange(ptr)) {
                     return false;
                 }
-                auto index = reinterpret_cast<const Bucket *>(ptr) - _first;
+                std::size_t head = reinterpret_cast<const Bucket *>(ptr) - _first;
+                std::size_t length = n;
+                _allocatedCount -= n;
+
+                // merge with the free extents on both sides
+                if (head != 0 && _nodes[head - 1].length != 0) {
+                    const std::size_t leftLength = _nodes[head - 1].length;
+                    head -= leftLength;
+                    length += leftLength;
+                    unlink(head);
+                }
+                const auto tail = head + length;
+                if (tail != kAllocatableObjectCount && _nodes[tail].length != 0) {
+                    length += _nodes[tail].length;
+                    unlink(tail);
+                }
 
-                auto node = _freeList + index;
-                if (node < _freeListTop) {
-                    auto currentTop = _freeListTop;
-                    _freeListTop = node;
-                    for (std::size_t i = 0; i < n; ++i) {
-                        node = node->next;
-                    }
-                    node->next = currentTop;
+                link(head, length);
+                return true;
+            }
 
-                } else {
-                    auto nextNode = _freeListTop->next;
-                    auto prevNode = _freeListTop;
-                    while (nextNode != nullptr && node < nextNode) {
-                        prevNode = nextNode;
-                        nextNode = nextNode->next;
+            /// allocate objects one by one, splitting whole extents
+            /// \param out array which receives pointers to objects
+            /// \param count object count
+            /// \return allocated object count. less than count if this chunk becomes full
+            std::size_t allocate_bulk(T **out, std::size_t count) noexcept {
+                std::size_t allocated = 0;
+                while (allocated < count) {
+                    const auto length = findLength(1);
+                    if (length == 0)
+                        break;
+
+                    const std::size_t head = _freeLists[length];
+                    const auto taken = length < count - allocated ? length : count - allocated;
+                    unlink(head);
+                    if (length != taken)
+                        link(head + taken, length - taken);
+
+                    for (std::size_t i = 0; i < taken; ++i) {
+                        out[allocated++] = reinterpret_cast<T *>(&_first[head + i]);
                     }
+                }
+                _allocatedCount += allocated;
+                return allocated;
+            }
 
-                    prevNode->next = node;
-
-                    for (std::size_t i = 0; i < n; ++i) {
-                        node = node->next;
-                    }
-                    node->next = nextNode;
+            /// deallocate objects one by one
+            /// \param ptrs objects of this chunk
+            /// \param count object count
+            void deallocate_bulk(T *const *ptrs, std::size_t count) noexcept {
+                for (std::size_t i = 0; i < count; ++i) {
+                    deallocate(ptrs[i], 1);
                 }
-                return true;
             }
         };
 
-        namespace detail {
-            template <std::size_t N> struct NBitmask {
-                static constexpr std::uint_fast64_t value =
-                    (1ull << (N - 1) | NBitmask<N - 1>::value);
-            };
-            template <> struct NBitmask<0> { static constexpr std::uint_fast64_t value = 1; };
-        } // namespace detail
-
         /// Block allocator subsystem
         /// This subsystem use bit operations to manage free areas.
         /// \tparam T object type
-        template <class T> class BitAllocationSubsystem {
+        /// \tparam Layout chunk layout
+        template <class T, class Layout = layouts::Packed> class BitAllocationSubsystem {
         public:
-            static constexpr std::size_t kBlockSize =
-                detail::BlockSize<sizeof(T), alignof(T)>::value;
-            static constexpr std::size_t kAllocatableObjectCount = 64;
+            static constexpr std::size_t kBlockSize = geometry::blockSize(sizeof(T), alignof(T));
+            static constexpr std::size_t kBucketAlignment =
+                detail::BucketAlignment<T, Layout>::value;
+            /// up to 64 blocks of one bitmap word, fewer if the chunk fits half the bytes
+            static constexpr std::size_t kAllocatableObjectCount =
+                ChunkGeometry<T>::objectCount(0, 16, 64, kBucketAlignment);
             static constexpr std::size_t kBucketSize = kAllocatableObjectCount * kBlockSize;
 
             using value_type = T;
 
-            template <class U> struct rebind { using other = BitAllocationSubsystem<U>; };
+            template <class U> struct rebind { using other = BitAllocationSubsystem<U, Layout>; };
 
         private:
-            static std::uint_fast64_t NBit(std::size_t n) {
-                switch (n) {
-#define C(n)                                                                                       \
-    case n:                                                                                        \
-        return detail::NBitmask<n>::value
-                    C(1);
-                    C(2);
-                    C(3);
-                    C(4);
-                    C(5);
-                    C(6);
-                    C(7);
-                    C(8);
-                    C(9);
-                    C(10);
-                    C(11);
-                    C(12);
-                    C(13);
-                    C(14);
-                    C(15);
-                    C(16);
-                    C(17);
-                    C(18);
-                    C(19);
-                    C(20);
-                    C(21);
-                    C(22);
-                    C(23);
-                    C(24);
-                    C(25);
-                    C(26);
-                    C(27);
-                    C(28);
-                    C(29);
-                    C(30);
-                    C(31);
-                    C(32);
-                    C(33);
-                    C(34);
-                    C(35);
-                    C(36);
-                    C(37);
-                    C(38);
-                    C(39);
-                    C(40);
-                    C(41);
-                    C(42);
-                    C(43);
-                    C(44);
-                    C(45);
-                    C(46);
-                    C(47);
-                    C(48);
-                    C(49);
-                    C(50);
-                    C(51);
-                    C(52);
-                    C(53);
-                    C(54);
-                    C(55);
-                    C(56);
-                    C(57);
-                    C(58);
-                    C(59);
-                    C(60);
-                    C(61);
-                    C(62);
-                    C(63);
-                    C(64);
-                default:
-                    return 0;
-#undef C
-                }
+            /// bits beyond kAllocatableObjectCount, which are always set
+            static constexpr std::uint_fast64_t kUnusableBlocks =
+                ~black::detail::lowerBits(kAllocatableObjectCount);
+
+            static std::uint_fast64_t NBit(std::size_t n) noexcept {
+                return n >= 64 ? ~std::uint_fast64_t() : (std::uint_fast64_t(1) << n) - 1;
             }
 
         private:
@@ -291,13 +682,13 @@ namespace black {
             std::uint_fast64_t _freeBlockList;
 
             /// bucket
-            typename std::aligned_storage<kBucketSize, alignof(T)>::type _bucket;
+            typename std::aligned_storage<kBucketSize, kBucketAlignment>::type _bucket;
             /// pointer to bucket top
             Bucket *_first;
 
         public:
             BitAllocationSubsystem() noexcept
-                : _freeBlockList()
+                : _freeBlockList(kUnusableBlocks)
                 , _bucket()
                 , _first(reinterpret_cast<Bucket *>(&_bucket)) {}
 
@@ -314,18 +705,29 @@ namespace black {
             /// \param n object count
             /// \return pointer to allocated area. nullptr if no more allocatable area
             T *allocate(std::size_t n) noexcept {
-                if (unlikely(_freeBlockList == 0xffffffffffffffff))
+                if (unlikely(full() || n > kAllocatableObjectCount))
                     return nullptr;
 
-                auto bitmask = NBit(n);
-                for (std::size_t i = 0; i < (kAllocatableObjectCount - n); ++i) {
-                    if ((_freeBlockList & bitmask) == 0) {
-                        _freeBlockList |= bitmask;
-                        return reinterpret_cast<T *>(_first + i);
-                    }
-                    bitmask <<= 1u;
-                }
-                return nullptr;
+                const auto head = black::detail::findFreeRun(_freeBlockList, n);
+                if (unlikely(head >= kAllocatableObjectCount))
+                    return nullptr;
+
+                _freeBlockList |= NBit(n) << head;
+                return reinterpret_cast<T *>(_first + head);
+            }
+
+            /// \return pointer to the first block
+            T *data() noexcept { return reinterpret_cast<T *>(_first); }
+
+            /// \return true if no more allocatable area
+            bool full() const noexcept { return _freeBlockList == 0xffffffffffffffff; }
+
+            /// \return true if no object is allocated
+            bool empty() const noexcept { return _freeBlockList == kUnusableBlocks; }
+
+            /// \return allocated object count
+            std::size_t size() const noexcept {
+                return black::detail::popCount(_freeBlockList & ~kUnusableBlocks);
             }
 
             /// deallocate area
@@ -335,100 +737,3034 @@ namespace black {
                 const auto index = reinterpret_cast<const Bucket *>(ptr) - _first;
                 if (unlikely(index < 0))
                     return false;
-                if (unlikely(index >= 64))
+                if (unlikely(index >= static_cast<std::ptrdiff_t>(kAllocatableObjectCount)))
                     return false;
 
                 _freeBlockList &= ~(NBit(n) << index);
                 return true;
             }
-        };
-    } // namespace subsystems
 
-    template <class T, class Subsystem = subsystems::BitAllocationSubsystem<T>>
-    class BlockAllocator {
-    public:
-        using AllocatorSubsystemType = Subsystem;
-        static constexpr std::size_t kBlockSize = AllocatorSubsystemType::kBlockSize;
+            /// allocate objects one by one at once
+            /// \param out array which receives pointers to objects
+            /// \param count object count
+            /// \return allocated object count. less than count if this chunk becomes full
+            std::size_t allocate_bulk(T **out, std::size_t count) noexcept {
+                const auto taken = black::detail::lowestSetBits(~_freeBlockList, count);
+                _freeBlockList |= taken;
+                return black::detail::storeBlocks(out, _first, taken) - out;
+            }
 
-        using value_type = T;
-        template <class U> struct rebind {
-            using other = BlockAllocator<U, typename Subsystem::template rebind<U>::other>;
+            /// deallocate objects one by one, updating the bitmap once
+            /// \param ptrs objects of this chunk
+            /// \param count object count
+            void deallocate_bulk(T *const *ptrs, std::size_t count) noexcept {
+                std::uint_fast64_t released = 0;
+                for (std::size_t i = 0; i < count; ++i) {
+                    released |= std::uint_fast64_t(1)
+                                << (reinterpret_cast<const Bucket *>(ptrs[i]) - _first);
+                }
+                _freeBlockList &= ~released;
+            }
         };
+        /// Block allocator subsystem
+        /// This subsystem manages free areas with two level bitmap.
+        /// Each leaf word holds 64 blocks and the summary word marks leaves which have free blocks.
+        /// \tparam T object type
+        /// \tparam ObjectCount allocatable object count (1 to 4096).
+        /// geometry::kAuto follows ChunkGeometry<T>
+        /// \tparam Layout chunk layout
+        template <class T, std::size_t ObjectCount = geometry::kAuto,
+                  class Layout = layouts::Packed>
+        class HierarchicalBitAllocationSubsystem {
+        public:
+            static constexpr std::size_t kBlockSize = geometry::blockSize(sizeof(T), alignof(T));
+            static constexpr std::size_t kBucketAlignment =
+                detail::BucketAlignment<T, Layout>::value;
+            /// a bit of each block in the leaves
+            static constexpr std::size_t kAllocatableObjectCount =
+                ObjectCount != geometry::kAuto
+                    ? ObjectCount
+                    : ChunkGeometry<T>::objectCount(1, 32, 4096, kBucketAlignment);
+            static constexpr std::size_t kBucketSize = kAllocatableObjectCount * kBlockSize;
 
-    private:
-        struct Node {
-            Node *next;
-            AllocatorSubsystemType allocator;
-        };
+            using value_type = T;
 
-        using AllocatorType = std::allocator<Node>;
+            template <class U> struct rebind {
+                using other = HierarchicalBitAllocationSubsystem<U, ObjectCount, Layout>;
+            };
 
-    private:
-        AllocatorType _internalAllocator;
-        Node *_allocators;
+        private:
+            static constexpr std::size_t kLeafCount = (kAllocatableObjectCount + 63) / 64;
 
-    private:
-        Node *allocateNewNode(Node *tail) {
-            auto newNode = _internalAllocator.allocate(1);
-            new (newNode) Node();
+            static_assert(0 < kAllocatableObjectCount && kLeafCount <= 64,
+                          "ObjectCount must be between 1 and 4096");
 
-            tail->next = newNode;
-            newNode->next = nullptr;
+        private:
+            struct Bucket {
+                char block[kBlockSize];
+            };
 
-            return newNode;
-        }
+        private:
+            /// used blocks
+            std::uint64_t _leaves[kLeafCount];
+            /// leaves which have free blocks
+            std::uint64_t _availableLeaves;
+            /// allocated object count
+            std::size_t _allocatedCount;
 
-    public:
-        BlockAllocator()
-            : _allocators(_internalAllocator.allocate(1)) {
-            new (_allocators) Node();
-            _allocators->next = nullptr;
-        }
+            /// bucket
+            typename std::aligned_storage<kBucketSize, kBucketAlignment>::type _bucket;
+            /// pointer to bucket top
+            Bucket *_first;
 
-        BlockAllocator(const BlockAllocator &) = delete;
-        BlockAllocator(BlockAllocator &&) = delete;
+        private:
+            /// mark blocks [head, head + n) as used
+            void use(std::size_t head, std::size_t n) noexcept {
+                while (n > 0) {
+                    const auto leaf = head / 64;
+                    const auto offset = head % 64;
+                    const auto count = n < 64 - offset ? n : 64 - offset;
+
+                    _leaves[leaf] |= black::detail::lowerBits(count) << offset;
+                    if (_leaves[leaf] == ~std::uint64_t())
+                        _availableLeaves &= ~(std::uint64_t(1) << leaf);
+
+                    head += count;
+                    n -= count;
+                }
+            }
 
-        BlockAllocator &operator=(const BlockAllocator &) = delete;
-        BlockAllocator &operator=(BlockAllocator &&) = delete;
+            /// mark blocks [head, head + n) as free
+            void release(std::size_t head, std::size_t n) noexcept {
+                if (likely(n == 1)) {
+                    _leaves[head / 64] &= ~(std::uint64_t(1) << (head % 64));
+                    _availableLeaves |= std::uint64_t(1) << (head / 64);
+                    return;
+                }
 
-        ~BlockAllocator() {
-            auto node = _allocators;
-            while (node != nullptr) {
-                auto next = node->next;
-                node->~Node();
-                _internalAllocator.deallocate(node, 1);
-                node = next;
+                while (n > 0) {
+                    const auto leaf = head / 64;
+                    const auto offset = head % 64;
+                    const auto count = n < 64 - offset ? n : 64 - offset;
+
+                    _leaves[leaf] &= ~(black::detail::lowerBits(count) << offset);
+                    _availableLeaves |= std::uint64_t(1) << leaf;
+
+                    head += count;
+                    n -= count;
+                }
             }
-        }
 
-    public:
-        T *allocate(std::size_t n) {
-            auto allocator = _allocators;
-            while (true) {
-                auto ptr = allocator->allocator.allocate(n);
-                if (ptr)
-                    return ptr;
+            /// search the lowest run of n free blocks
+            /// \return index of the run head. kAllocatableObjectCount if no run is found
+            std::size_t findFreeRun(std::size_t n) const noexcept {
+                // free blocks at the top of preceding leaves
+                std::size_t run = 0;
+                for (std::size_t leaf = 0; leaf < kLeafCount; ++leaf) {
+                    const auto used = _leaves[leaf];
+                    if (run != 0) {
+                        const auto rest = n - run;
+                        if (rest <= 64 && (used & black::detail::lowerBits(rest)) == 0)
+                            return leaf * 64 - run;
+                        if (rest > 64 && used == 0) {
+                            run += 64;
+                            continue;
+                        }
+                    }
 
-                if (allocator->next == nullptr)
-                    break;
-                allocator = allocator->next;
+                    if (n <= 64) {
+                        const auto head = black::detail::findFreeRun(used, n);
+                        if (head < 64)
+                            return leaf * 64 + head;
+                    }
+
+                    run = used == 0 ? 64 : black::detail::countLeadingZeros(used);
+                }
+                return kAllocatableObjectCount;
             }
 
-            auto node = allocateNewNode(allocator);
+        public:
+            HierarchicalBitAllocationSubsystem() noexcept
+                : _leaves()
+                , _availableLeaves(black::detail::lowerBits(kLeafCount))
+                , _allocatedCount(0)
+                , _bucket()
+                , _first(reinterpret_cast<Bucket *>(&_bucket)) {
+                // blocks beyond kAllocatableObjectCount are never allocated
+                _leaves[kLeafCount - 1] =
+                    ~black::detail::lowerBits(kAllocatableObjectCount - (kLeafCount - 1) * 64);
+            }
 
-            return node->allocator.allocate(1);
-        }
+            HierarchicalBitAllocationSubsystem(const HierarchicalBitAllocationSubsystem &) = delete;
+            HierarchicalBitAllocationSubsystem(HierarchicalBitAllocationSubsystem &&) = delete;
 
-        void deallocate(T *ptr, std::size_t n) {
-            auto allocator = _allocators;
-            while (allocator != nullptr) {
-                if (allocator->allocator.deallocate(ptr, n)) {
-                    return;
+            HierarchicalBitAllocationSubsystem &
+            operator=(const HierarchicalBitAllocationSubsystem &) = delete;
+            HierarchicalBitAllocationSubsystem &
+            operator=(HierarchicalBitAllocationSubsystem &&) = delete;
+
+            ~HierarchicalBitAllocationSubsystem() = default;
+
+        public:
+            /// allocate memory
+            /// \param n object count
+            /// \return pointer to allocated area. nullptr if no more allocatable area
+            T *allocate(std::size_t n) noexcept {
+                if (unlikely(full() || n > kAllocatableObjectCount))
+                    return nullptr;
+
+                if (likely(n == 1)) {
+                    const auto leaf = black::detail::countTrailingZeros(_availableLeaves);
+                    const auto offset = black::detail::countTrailingZeros(~_leaves[leaf]);
+
+                    _leaves[leaf] |= std::uint64_t(1) << offset;
+                    if (_leaves[leaf] == ~std::uint64_t())
+                        _availableLeaves &= ~(std::uint64_t(1) << leaf);
+                    ++_allocatedCount;
+                    return reinterpret_cast<T *>(_first + (leaf * 64 + offset));
                 }
-                allocator = allocator->next;
+
+                const auto head = findFreeRun(n);
+                if (unlikely(head >= kAllocatableObjectCount))
+                    return nullptr;
+
+                use(head, n);
+                _allocatedCount += n;
+                return reinterpret_cast<T *>(_first + head);
             }
-        }
-    };
+
+            /// \return pointer to the first block
+            T *data() noexcept { return reinterpret_cast<T *>(_first); }
+
+            /// \return true if no more allocatable area
+            bool full() const noexcept { return _availableLeaves == 0; }
+
+            /// \return true if no object is allocated
+            bool empty() const noexcept { return _allocatedCount == 0; }
+
+            /// \return allocated object count
+            std::size_t size() const noexcept { return _allocatedCount; }
+
+            /// deallocate area
+            /// \param ptr area to deallocate
+            /// \param n object count
+            bool deallocate(const T *ptr, std::size_t n) noexcept {
+                const auto index = reinterpret_cast<const Bucket *>(ptr) - _first;
+                if (unlikely(index < 0))
+                    return false;
+                if (unlikely(static_cast<std::size_t>(index) >= kAllocatableObjectCount))
+                    return false;
+
+                release(static_cast<std::size_t>(index), n);
+                _allocatedCount -= n;
+                return true;
+            }
+
+            /// allocate objects one by one, taking many bits of a word at once
+            /// \param out array which receives pointers to objects
+            /// \param count object count
+            /// \return allocated object count. less than count if this chunk becomes full
+            std::size_t allocate_bulk(T **out, std::size_t count) noexcept {
+                auto next = out;
+                for (auto rest = count; rest > 0 && !full();) {
+                    const auto leaf = black::detail::countTrailingZeros(_availableLeaves);
+                    const auto taken = black::detail::lowestSetBits(~_leaves[leaf], rest);
+
+                    _leaves[leaf] |= taken;
+                    if (_leaves[leaf] == ~std::uint64_t())
+                        _availableLeaves &= ~(std::uint64_t(1) << leaf);
+
+                    const auto first = next;
+                    next = black::detail::storeBlocks(next, _first + leaf * 64, taken);
+                    rest -= next - first;
+                }
+                _allocatedCount += next - out;
+                return next - out;
+            }
+
+            /// deallocate objects one by one, updating each leaf and the summary once
+            /// \param ptrs objects of this chunk
+            /// \param count object count
+            void deallocate_bulk(T *const *ptrs, std::size_t count) noexcept {
+                std::uint64_t released[kLeafCount] = {};
+                std::uint64_t releasedLeaves = 0;
+                for (std::size_t i = 0; i < count; ++i) {
+                    const auto index = static_cast<std::size_t>(
+                        reinterpret_cast<const Bucket *>(ptrs[i]) - _first);
+                    released[index / 64] |= std::uint64_t(1) << (index % 64);
+                    releasedLeaves |= std::uint64_t(1) << (index / 64);
+                }
+
+                for (auto leaves = releasedLeaves; leaves != 0; leaves &= leaves - 1) {
+                    const auto leaf = black::detail::countTrailingZeros(leaves);
+                    _leaves[leaf] &= ~released[leaf];
+                }
+                _availableLeaves |= releasedLeaves;
+                _allocatedCount -= count;
+            }
+        };
+
+        /// Block allocator subsystem
+        /// This subsystem claims and releases bits of an atomic bitmap,
+        /// so threads can share a chunk without locks.
+        /// \tparam T object type
+        /// \tparam Layout chunk layout
+        template <class T, class Layout = layouts::Packed> class AtomicBitAllocationSubsystem {
+        public:
+            static constexpr std::size_t kBlockSize = geometry::blockSize(sizeof(T), alignof(T));
+            static constexpr std::size_t kBucketAlignment =
+                detail::BucketAlignment<T, Layout>::value;
+            /// up to 64 blocks of one bitmap word, fewer if the chunk fits half the bytes
+            static constexpr std::size_t kAllocatableObjectCount =
+                ChunkGeometry<T>::objectCount(0, 16, 64, kBucketAlignment);
+            static constexpr std::size_t kBucketSize = kAllocatableObjectCount * kBlockSize;
+            static constexpr bool kThreadSafe = true;
+
+            using value_type = T;
+
+            template <class U> struct rebind {
+                using other = AtomicBitAllocationSubsystem<U, Layout>;
+            };
+
+        private:
+            /// bits beyond kAllocatableObjectCount, which are always set
+            static constexpr std::uint64_t kUnusableBlocks =
+                ~black::detail::lowerBits(kAllocatableObjectCount);
+
+            struct Bucket {
+                char block[kBlockSize];
+            };
+
+        private:
+            std::atomic<std::uint64_t> _freeBlockList;
+
+            /// bucket
+            typename std::aligned_storage<kBucketSize, kBucketAlignment>::type _bucket;
+            /// pointer to bucket top
+            Bucket *_first;
+
+        public:
+            AtomicBitAllocationSubsystem() noexcept
+                : _freeBlockList(kUnusableBlocks)
+                , _bucket()
+                , _first(reinterpret_cast<Bucket *>(&_bucket)) {}
+
+            AtomicBitAllocationSubsystem(const AtomicBitAllocationSubsystem &) = delete;
+            AtomicBitAllocationSubsystem(AtomicBitAllocationSubsystem &&) = delete;
+
+            AtomicBitAllocationSubsystem &operator=(const AtomicBitAllocationSubsystem &) = delete;
+            AtomicBitAllocationSubsystem &operator=(AtomicBitAllocationSubsystem &&) = delete;
+
+            ~AtomicBitAllocationSubsystem() = default;
+
+        public:
+            /// allocate memory
+            /// \param n object count
+            /// \return pointer to allocated area. nullptr if no more allocatable area
+            T *allocate(std::size_t n) noexcept {
+                if (unlikely(n > kAllocatableObjectCount))
+                    return nullptr;
+
+                auto used = _freeBlockList.load(std::memory_order_relaxed);
+                while (true) {
+                    if (unlikely(used == ~std::uint64_t()))
+                        return nullptr;
+
+                    const auto head = black::detail::findFreeRun(used, n);
+                    if (unlikely(head >= kAllocatableObjectCount))
+                        return nullptr;
+
+                    // acquire pairs with the release of the previous owner
+                    const auto claimed = used | (black::detail::lowerBits(n) << head);
+                    if (_freeBlockList.compare_exchange_weak(used, claimed,
+                                                             std::memory_order_acquire,
+                                                             std::memory_order_relaxed))
+                        return reinterpret_cast<T *>(_first + head);
+                }
+            }
+
+            /// \return pointer to the first block
+            T *data() noexcept { return reinterpret_cast<T *>(_first); }
+
+            /// \return true if no more allocatable area
+            bool full() const noexcept {
+                return _freeBlockList.load(std::memory_order_relaxed) == ~std::uint64_t();
+            }
+
+            /// \return true if no object is allocated
+            bool empty() const noexcept {
+                return _freeBlockList.load(std::memory_order_relaxed) == kUnusableBlocks;
+            }
+
+            /// \return allocated object count
+            std::size_t size() const noexcept {
+                return black::detail::popCount(_freeBlockList.load(std::memory_order_relaxed) &
+                                               ~kUnusableBlocks);
+            }
+
+            /// deallocate area
+            /// \param ptr area to deallocate
+            /// \param n object count
+            bool deallocate(const T *ptr, std::size_t n) noexcept {
+                const auto index = reinterpret_cast<const Bucket *>(ptr) - _first;
+                if (unlikely(index < 0))
+                    return false;
+                if (unlikely(index >= static_cast<std::ptrdiff_t>(kAllocatableObjectCount)))
+                    return false;
+
+                _freeBlockList.fetch_and(~(black::detail::lowerBits(n) << index),
+                                         std::memory_order_release);
+                return true;
+            }
+
+            /// allocate objects one by one with one compare and swap
+            /// \param out array which receives pointers to objects
+            /// \param count object count
+            /// \return allocated object count. less than count if this chunk becomes full
+            std::size_t allocate_bulk(T **out, std::size_t count) noexcept {
+                auto used = _freeBlockList.load(std::memory_order_relaxed);
+                std::uint64_t taken;
+                do {
+                    taken = black::detail::lowestSetBits(~used, count);
+                    if (taken == 0)
+                        return 0;
+                } while (!_freeBlockList.compare_exchange_weak(
+                    used, used | taken, std::memory_order_acquire, std::memory_order_relaxed));
+                return black::detail::storeBlocks(out, _first, taken) - out;
+            }
+
+            /// deallocate objects one by one with one atomic operation
+            /// \param ptrs objects of this chunk
+            /// \param count object count
+            void deallocate_bulk(T *const *ptrs, std::size_t count) noexcept {
+                std::uint64_t released = 0;
+                for (std::size_t i = 0; i < count; ++i) {
+                    released |= std::uint64_t(1)
+                                << (reinterpret_cast<const Bucket *>(ptrs[i]) - _first);
+                }
+                _freeBlockList.fetch_and(~released, std::memory_order_release);
+            }
+        };
+
+        /// Block allocator subsystem for arenas
+        /// This subsystem bumps an index to allocate, and never frees objects one by one.
+        /// reset() frees every object at once.
+        /// \tparam T object type
+        /// \tparam ObjectCount allocatable object count. geometry::kAuto follows ChunkGeometry<T>
+        /// \tparam Layout chunk layout
+        template <class T, std::size_t ObjectCount = geometry::kAuto,
+                  class Layout = layouts::Packed>
+        class MonotonicAllocationSubsystem {
+        public:
+            static constexpr std::size_t kBlockSize = geometry::blockSize(sizeof(T), alignof(T));
+            static constexpr std::size_t kBucketAlignment =
+                detail::BucketAlignment<T, Layout>::value;
+            static constexpr std::size_t kAllocatableObjectCount =
+                ObjectCount != geometry::kAuto
+                    ? ObjectCount
+                    : ChunkGeometry<T>::objectCount(0, 16, ~std::size_t(), kBucketAlignment);
+            static constexpr std::size_t kBucketSize = kAllocatableObjectCount * kBlockSize;
+            static constexpr bool kMonotonic = true;
+
+            using value_type = T;
+
+            template <class U> struct rebind {
+                using other = MonotonicAllocationSubsystem<U, ObjectCount, Layout>;
+            };
+
+        private:
+            struct Bucket {
+                char block[kBlockSize];
+            };
+
+        private:
+            /// first block which is not allocated
+            std::size_t _next;
+
+            /// bucket
+            typename std::aligned_storage<kBucketSize, kBucketAlignment>::type _bucket;
+            /// pointer to bucket top
+            Bucket *_first;
+
+        public:
+            MonotonicAllocationSubsystem() noexcept
+                : _next(0)
+                , _bucket()
+                , _first(reinterpret_cast<Bucket *>(&_bucket)) {}
+
+            MonotonicAllocationSubsystem(const MonotonicAllocationSubsystem &) = delete;
+            MonotonicAllocationSubsystem(MonotonicAllocationSubsystem &&) = delete;
+
+            MonotonicAllocationSubsystem &operator=(const MonotonicAllocationSubsystem &) = delete;
+            MonotonicAllocationSubsystem &operator=(MonotonicAllocationSubsystem &&) = delete;
+
+            ~MonotonicAllocationSubsystem() = default;
+
+        public:
+            /// allocate memory
+            /// \param n object count
+            /// \return pointer to allocated area. nullptr if no more allocatable area
+            T *allocate(std::size_t n) noexcept {
+                if (unlikely(n > kAllocatableObjectCount - _next))
+                    return nullptr;
+
+                auto ptr = reinterpret_cast<T *>(_first + _next);
+                _next += n;
+                return ptr;
+            }
+
+            /// \return pointer to the first block
+            T *data() noexcept { return reinterpret_cast<T *>(_first); }
+
+            /// \return true if no more allocatable area
+            bool full() const noexcept { return _next == kAllocatableObjectCount; }
+
+            /// \return true if no object is allocated
+            bool empty() const noexcept { return _next == 0; }
+
+            /// \return allocated object count
+            std::size_t size() const noexcept { return _next; }
+
+            /// objects are freed only by reset
+            /// \param ptr area to deallocate
+            /// \return true if ptr is in this chunk
+            bool deallocate(const T *ptr, std::size_t) noexcept {
+                const auto index = reinterpret_cast<const Bucket *>(ptr) - _first;
+                return index >= 0 && static_cast<std::size_t>(index) < kAllocatableObjectCount;
+            }
+
+            /// free every object
+            void reset() noexcept { _next = 0; }
+
+            /// allocate objects one by one, bumping the index once
+            /// \param out array which receives pointers to objects
+            /// \param count object count
+            /// \return allocated object count. less than count if this chunk becomes full
+            std::size_t allocate_bulk(T **out, std::size_t count) noexcept {
+                const auto rest = kAllocatableObjectCount - _next;
+                const auto allocated = count < rest ? count : rest;
+                for (std::size_t i = 0; i < allocated; ++i) {
+                    out[i] = reinterpret_cast<T *>(_first + _next + i);
+                }
+                _next += allocated;
+                return allocated;
+            }
+
+            /// objects are freed only by reset
+            void deallocate_bulk(T *const *, std::size_t) noexcept {}
+        };
+    } // namespace subsystems
+
+    /// upstream memory sources of chunks
+    /// A source has
+    ///   void *allocate(std::size_t bytes, std::size_t alignment) and
+    ///   void deallocate(void *ptr, std::size_t bytes, std::size_t alignment) noexcept.
+    namespace sources {
+        /// source using global operator new and delete (default)
+        class NewDeleteSource {
+        public:
+            /// allocate memory aligned to the boundary
+            /// \param bytes byte count
+            /// \param alignment power of two boundary
+            /// \return pointer to allocated area
+            void *allocate(std::size_t bytes, std::size_t alignment) {
+#ifdef __cpp_aligned_new
+                return ::operator new(bytes, static_cast<std::align_val_t>(alignment));
+#else
+                // the pointer returned by operator new is kept just before the aligned area
+                auto raw = static_cast<char *>(::operator new(bytes + alignment + sizeof(void *)));
+                auto address = reinterpret_cast<std::uintptr_t>(raw + sizeof(void *));
+                auto aligned =
+                    reinterpret_cast<void **>((address + alignment - 1) & ~(alignment - 1));
+                aligned[-1] = raw;
+                return aligned;
+#endif
+            }
+
+            /// deallocate memory allocated by allocate
+            /// \param ptr area to deallocate
+            /// \param alignment boundary passed to allocate
+            void deallocate(void *ptr, std::size_t, std::size_t alignment) noexcept {
+#ifdef __cpp_aligned_new
+                ::operator delete(ptr, static_cast<std::align_val_t>(alignment));
+#else
+                (void)alignment;
+                ::operator delete(static_cast<void **>(ptr)[-1]);
+#endif
+            }
+        };
+
+#ifdef BLACK_HAS_MMAP
+        /// huge page usage of MmapSource
+        enum class HugePage {
+            /// normal pages
+            Disabled,
+            /// transparent huge pages with madvise(MADV_HUGEPAGE)
+            Transparent,
+            /// MAP_HUGETLB, or transparent huge pages if no huge page is reserved
+            Explicit,
+        };
+
+        /// slab source which carves many chunks out of large anonymous mappings.
+        /// freed chunks are reused for the same size and all mappings are unmapped at
+        /// destruction. spans of kUnmapThreshold bytes or more get their own mapping, which is
+        /// unmapped when the span is freed, so spans of many sizes are not kept forever.
+        /// \tparam Mode huge page usage
+        /// \tparam MappingSize byte count of each mapping
+        template <HugePage Mode = HugePage::Disabled, std::size_t MappingSize = 4u << 20u>
+        class MmapSource {
+        public:
+            /// transparent huge pages are used if a mapping is aligned to this boundary
+            static constexpr std::size_t kHugePageSize = 2u << 20u;
+            /// spans of this byte count or more are mapped one by one, like glibc malloc does.
+            /// with huge pages, a span has its own mapping if it fills a huge page.
+            static constexpr std::size_t kOwnMappingSize =
+                Mode == HugePage::Disabled ? (128u << 10u) : kHugePageSize;
+            /// spans of this byte count or more are unmapped when they are freed.
+            /// spans which do not fit in a mapping always have their own.
+            static constexpr std::size_t kUnmapThreshold =
+                kOwnMappingSize < MappingSize ? kOwnMappingSize : MappingSize;
+
+        private:
+            struct Mapping {
+                void *address;
+                std::size_t size;
+            };
+
+            struct FreeSpan {
+                FreeSpan *next;
+            };
+
+            /// freed spans of the same size
+            struct FreeList {
+                std::size_t bytes;
+                std::size_t alignment;
+                FreeSpan *head;
+            };
+
+        private:
+            /// slabs
+            std::vector<Mapping> _mappings;
+            /// spans of their own mappings, keyed by address
+            std::unordered_map<void *, std::size_t> _ownMappings;
+            /// free lists of every size allocated from slabs. created by allocate,
+            /// so deallocate never allocates
+            std::vector<FreeList> _freeLists;
+            /// unused area of the last mapping
+            char *_current;
+            char *_end;
+
+        private:
+            /// map size bytes aligned to alignment
+            static void *map(std::size_t size, std::size_t alignment) {
+                const auto pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+                if (alignment < pageSize)
+                    alignment = pageSize;
+
+#ifdef MAP_HUGETLB
+                if (Mode == HugePage::Explicit && size % kHugePageSize == 0 &&
+                    alignment <= kHugePageSize) {
+                    auto address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                    if (address != MAP_FAILED)
+                        return address;
+                }
+#endif
+                if (Mode != HugePage::Disabled && alignment < kHugePageSize)
+                    alignment = kHugePageSize;
+
+                // map extra area and trim both ends to align the head
+                const auto mappedSize = size + alignment - pageSize;
+                auto mapped = ::mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (mapped == MAP_FAILED)
+                    throw std::bad_alloc();
+
+                const auto begin = reinterpret_cast<std::uintptr_t>(mapped);
+                const auto aligned = (begin + alignment - 1) & ~(alignment - 1);
+                if (aligned != begin)
+                    ::munmap(mapped, aligned - begin);
+                if (aligned + size != begin + mappedSize)
+                    ::munmap(reinterpret_cast<void *>(aligned + size),
+                             begin + mappedSize - (aligned + size));
+
+#ifdef MADV_HUGEPAGE
+                if (Mode != HugePage::Disabled)
+                    ::madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+#endif
+                return reinterpret_cast<void *>(aligned);
+            }
+
+            /// \return bytes rounded up to pages
+            static std::size_t pageCeil(std::size_t bytes) noexcept {
+                const auto pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+                return (bytes + pageSize - 1) & ~(pageSize - 1);
+            }
+
+            FreeList *findFreeList(std::size_t bytes, std::size_t alignment) noexcept {
+                for (auto &list : _freeLists) {
+                    if (list.bytes == bytes && list.alignment == alignment)
+                        return &list;
+                }
+                return nullptr;
+            }
+
+            void release() noexcept {
+                for (const auto &mapping : _mappings) {
+                    ::munmap(mapping.address, mapping.size);
+                }
+                for (const auto &mapping : _ownMappings) {
+                    ::munmap(mapping.first, mapping.second);
+                }
+                _mappings.clear();
+                _ownMappings.clear();
+                _freeLists.clear();
+                _current = _end = nullptr;
+            }
+
+        public:
+            MmapSource() noexcept
+                : _current(nullptr)
+                , _end(nullptr) {}
+
+            MmapSource(const MmapSource &) = delete;
+            MmapSource(MmapSource &&other) noexcept
+                : _mappings(std::move(other._mappings))
+                , _ownMappings(std::move(other._ownMappings))
+                , _freeLists(std::move(other._freeLists))
+                , _current(other._current)
+                , _end(other._end) {
+                other._mappings.clear();
+                other._ownMappings.clear();
+                other._current = other._end = nullptr;
+            }
+
+            MmapSource &operator=(const MmapSource &) = delete;
+            MmapSource &operator=(MmapSource &&other) noexcept {
+                if (this != &other) {
+                    release();
+                    _mappings.swap(other._mappings);
+                    _ownMappings.swap(other._ownMappings);
+                    _freeLists.swap(other._freeLists);
+                    std::swap(_current, other._current);
+                    std::swap(_end, other._end);
+                }
+                return *this;
+            }
+
+            ~MmapSource() { release(); }
+
+        public:
+            /// carve a span out of the last mapping
+            /// \param bytes byte count
+            /// \param alignment power of two boundary
+            /// \return pointer to allocated area
+            void *allocate(std::size_t bytes, std::size_t alignment) {
+                if (bytes < sizeof(FreeSpan))
+                    bytes = sizeof(FreeSpan);
+
+                if (bytes >= kUnmapThreshold) {
+                    const auto size = pageCeil(bytes);
+                    auto mapping = map(size, alignment);
+                    try {
+                        _ownMappings.emplace(mapping, size);
+                    } catch (...) {
+                        ::munmap(mapping, size);
+                        throw;
+                    }
+                    return mapping;
+                }
+
+                auto list = findFreeList(bytes, alignment);
+                if (list == nullptr) {
+                    _freeLists.push_back({bytes, alignment, nullptr});
+                    list = &_freeLists.back();
+                }
+                if (list->head != nullptr) {
+                    auto span = list->head;
+                    list->head = span->next;
+                    return span;
+                }
+
+                auto head = reinterpret_cast<char *>(
+                    (reinterpret_cast<std::uintptr_t>(_current) + alignment - 1) &
+                    ~(alignment - 1));
+                if (_current == nullptr || head + bytes > _end) {
+                    // spans larger than a mapping are unmapped one by one
+                    _mappings.reserve(_mappings.size() + 1);
+                    auto mapping = map(MappingSize, alignment);
+                    _mappings.push_back({mapping, MappingSize});
+                    head = static_cast<char *>(mapping);
+                    _end = head + MappingSize;
+                }
+                _current = head + bytes;
+                return head;
+            }
+
+            /// keep a span to reuse it for the same size, or unmap a span of its own mapping
+            /// \param ptr area to deallocate
+            /// \param bytes byte count passed to allocate
+            /// \param alignment boundary passed to allocate
+            void deallocate(void *ptr, std::size_t bytes, std::size_t alignment) noexcept {
+                if (bytes < sizeof(FreeSpan))
+                    bytes = sizeof(FreeSpan);
+
+                if (bytes >= kUnmapThreshold) {
+                    auto mapping = _ownMappings.find(ptr);
+                    ::munmap(mapping->first, mapping->second);
+                    _ownMappings.erase(mapping);
+                    return;
+                }
+
+                // allocate created the list of this size
+                auto list = findFreeList(bytes, alignment);
+                auto span = static_cast<FreeSpan *>(ptr);
+                span->next = list->head;
+                list->head = span;
+            }
+        };
+#endif
+
+#ifdef BLACK_HAS_MEMORY_RESOURCE
+        /// source using std::pmr::memory_resource
+        class MemoryResourceSource {
+        private:
+            std::pmr::memory_resource *_resource;
+
+        public:
+            explicit MemoryResourceSource(
+                std::pmr::memory_resource *resource = std::pmr::get_default_resource()) noexcept
+                : _resource(resource) {}
+
+            void *allocate(std::size_t bytes, std::size_t alignment) {
+                return _resource->allocate(bytes, alignment);
+            }
+
+            void deallocate(void *ptr, std::size_t bytes, std::size_t alignment) noexcept {
+                _resource->deallocate(ptr, bytes, alignment);
+            }
+
+            std::pmr::memory_resource *resource() const noexcept { return _resource; }
+        };
+#endif
+    } // namespace sources
+
+    /// statistics policies of allocators
+    namespace stats {
+        /// counted events
+        enum Event : std::size_t {
+            /// allocated objects
+            kAllocation,
+            /// deallocated objects
+            kDeallocation,
+            /// chunks which could not serve an allocation while searching free area
+            kFailedProbe,
+            /// chunks allocated from the upstream
+            kChunkAllocation,
+            /// chunks released to the upstream
+            kChunkRelease,
+            /// objects of large arrays allocated from the upstream
+            kLargeAllocation,
+            /// objects of large arrays released to the upstream
+            kLargeDeallocation,
+            kEventCount
+        };
+
+        /// snapshot of allocator statistics
+        struct Snapshot {
+            std::size_t allocations = 0;
+            std::size_t deallocations = 0;
+            std::size_t failedProbes = 0;
+            std::size_t chunkAllocations = 0;
+            std::size_t chunkReleases = 0;
+            std::size_t largeAllocations = 0;
+            std::size_t largeDeallocations = 0;
+
+            /// current chunk count
+            std::size_t chunkCount = 0;
+            /// objects the current chunks can hold
+            std::size_t capacity = 0;
+            /// allocated objects
+            std::size_t liveObjects = 0;
+            /// allocated objects of each chunk. empty if chunks are not sampled
+            std::vector<std::size_t> occupancy;
+            /// free blocks of chunks in use divided by blocks of chunks in use.
+            /// 0 if chunks in use are full, and near 1 if few objects are scattered over them.
+            double fragmentation = 0;
+
+            /// add counted events
+            void add(const std::size_t (&counts)[kEventCount]) noexcept {
+                allocations += counts[kAllocation];
+                deallocations += counts[kDeallocation];
+                failedProbes += counts[kFailedProbe];
+                chunkAllocations += counts[kChunkAllocation];
+                chunkReleases += counts[kChunkRelease];
+                largeAllocations += counts[kLargeAllocation];
+                largeDeallocations += counts[kLargeDeallocation];
+            }
+        };
+
+        /// no statistics. counting costs nothing
+        struct Disabled {
+            static constexpr bool kEnabled = false;
+
+            /// \tparam Shared true if threads count events concurrently
+            template <bool Shared> struct Recorder {
+                void count(Event, std::size_t = 1) noexcept {}
+                void addTo(Snapshot &) const noexcept {}
+            };
+        };
+
+        /// count events
+        struct Counting {
+            static constexpr bool kEnabled = true;
+
+            /// \tparam Shared true if threads count events concurrently
+            template <bool Shared, class = void> class Recorder {
+            private:
+                std::atomic<std::size_t> _counts[kEventCount];
+
+            public:
+                Recorder() noexcept
+                    : _counts() {}
+
+                /// count an event. only one thread counts events, so no atomic operation is used
+                void count(Event event, std::size_t n = 1) noexcept {
+                    auto &counter = _counts[event];
+                    counter.store(counter.load(std::memory_order_relaxed) + n,
+                                  std::memory_order_relaxed);
+                }
+
+                void addTo(Snapshot &snapshot) const noexcept {
+                    std::size_t counts[kEventCount];
+                    for (std::size_t i = 0; i < kEventCount; ++i) {
+                        counts[i] = _counts[i].load(std::memory_order_relaxed);
+                    }
+                    snapshot.add(counts);
+                }
+            };
+
+            /// counters are split into slots of threads, so threads rarely share a cache line.
+            /// slots are merged when a snapshot is taken.
+            template <class Dummy> class Recorder<true, Dummy> {
+            private:
+                static constexpr std::size_t kSlotCount = 8;
+                static constexpr std::size_t kCacheLineSize = 64;
+
+                struct alignas(kCacheLineSize) Slot {
+                    std::atomic<std::size_t> counts[kEventCount];
+                };
+                static_assert(sizeof(Slot) == kCacheLineSize, "counters of a slot fill a line");
+
+                Slot _slots[kSlotCount];
+
+                static std::size_t threadSlot() noexcept {
+                    static std::atomic<std::size_t> next(0);
+                    static thread_local std::size_t slot =
+                        next.fetch_add(1, std::memory_order_relaxed) % kSlotCount;
+                    return slot;
+                }
+
+            public:
+                Recorder() noexcept
+                    : _slots() {}
+
+                void count(Event event, std::size_t n = 1) noexcept {
+                    _slots[threadSlot()].counts[event].fetch_add(n, std::memory_order_relaxed);
+                }
+
+                void addTo(Snapshot &snapshot) const noexcept {
+                    std::size_t counts[kEventCount] = {};
+                    for (auto &slot : _slots) {
+                        for (std::size_t i = 0; i < kEventCount; ++i) {
+                            counts[i] += slot.counts[i].load(std::memory_order_relaxed);
+                        }
+                    }
+                    snapshot.add(counts);
+                }
+            };
+        };
+    } // namespace stats
+
+    /// \tparam T object type
+    /// \tparam Subsystem allocation subsystem of each chunk
+    /// \tparam Upstream source of chunks. it must be thread safe if the subsystem is.
+    /// \tparam Stats statistics policy (stats::Disabled or stats::Counting)
+    template <class T, class Subsystem = subsystems::BitAllocationSubsystem<T>,
+              class Upstream = sources::NewDeleteSource, class Stats = stats::Disabled>
+    class BlockAllocator {
+    public:
+        using AllocatorSubsystemType = Subsystem;
+        using UpstreamType = Upstream;
+        static constexpr std::size_t kBlockSize = AllocatorSubsystemType::kBlockSize;
+        /// true if threads can share this allocator.
+        /// chunks are shared by threads and new chunks are published with compare and swap.
+        static constexpr bool kThreadSafe = detail::IsThreadSafeSubsystem<Subsystem>::value;
+        /// true if this allocator is an arena.
+        /// deallocate does nothing and reset frees every object at once.
+        static constexpr bool kMonotonic = detail::IsMonotonicSubsystem<Subsystem>::value;
+        /// arrays of more objects than this are large.
+        /// a large array gets its own span of the upstream, so it never searches chunks.
+        /// reset of an arena does not free large arrays.
+        /// the upstream decides whether a freed span is kept: sources::MmapSource unmaps spans
+        /// of kUnmapThreshold bytes or more, and keeps smaller ones for arrays of the same size.
+        static constexpr std::size_t kLargeThreshold =
+            AllocatorSubsystemType::kAllocatableObjectCount;
+        /// empty chunks kept by default before releasing them to the upstream
+        static constexpr std::size_t kDefaultCachedEmptyNodeCount = 1;
+        /// chunks allocated at once from the upstream are doubled up to this count by default
+        static constexpr std::size_t kDefaultMaxBatchNodeCount = 64;
+        /// chunks of thread safe subsystems probed when the hinted chunk cannot serve an
+        /// allocation, before allocating new chunks
+        static constexpr std::size_t kSharedProbeCount = 16;
+
+        using value_type = T;
+        template <class U> struct rebind {
+            using other =
+                BlockAllocator<U, typename Subsystem::template rebind<U>::other, Upstream, Stats>;
+        };
+
+    private:
+        struct Node {
+            /// next node of all nodes
+            Node *next;
+            /// previous node of all nodes
+            Node *prev;
+            /// previous node of nodes which have free area
+            Node *prevAvailable;
+            /// next node of nodes which have free area
+            Node *nextAvailable;
+            bool available;
+            /// first node of the batch allocated together with this node
+            Node *batch;
+            /// node count of the batch. valid in the first node
+            std::size_t batchNodeCount;
+            /// empty node count of the batch. valid in the first node
+            std::size_t emptyBatchNodeCount;
+            /// reset count of the arena when this node was used last
+            std::size_t epoch;
+            /// objects of this node in the running deallocate_bulk. 0 outside of it
+            std::size_t bulkCount;
+            /// next slot of this node in the objects grouped by deallocate_bulk
+            std::size_t bulkOffset;
+            AllocatorSubsystemType allocator;
+        };
+
+        /// every node is placed at a multiple of this boundary,
+        /// so the node owning an object is found by masking the object address.
+        /// nodes of a batch are placed contiguously at this stride.
+        static constexpr std::size_t kNodeAlignment = detail::ceilPowerOfTwo(sizeof(Node));
+
+    public:
+        /// bytes of a chunk, header included
+        static constexpr std::size_t kChunkSize = kNodeAlignment;
+
+    private:
+        /// all nodes
+        std::atomic<Node *> _allocators;
+        /// nodes which have free area
+        Node *_availableAllocators;
+        std::size_t _nodeCount;
+        /// empty nodes in _availableAllocators
+        std::size_t _emptyNodeCount;
+        /// empty nodes kept before releasing them to the upstream
+        std::size_t _cachedEmptyNodeCount;
+        /// node which allocations of thread safe subsystems try first.
+        /// such nodes are never released, so a hinted node stays valid
+        std::atomic<Node *> _sharedHint;
+        /// node after which the next probe starts
+        std::atomic<Node *> _sharedCursor;
+        /// node count of the next batch
+        std::atomic<std::size_t> _batchNodeCount;
+        std::size_t _maxBatchNodeCount;
+        /// nodes kept by reserve
+        std::size_t _reservedNodeCount;
+        /// reset count of the arena
+        std::size_t _epoch;
+        /// node the arena allocates from. the arena moves toward the head of all nodes
+        Node *_cursor;
+        /// node the arena allocates from first
+        Node *_arenaTail;
+        Upstream _upstream;
+        typename Stats::template Recorder<kThreadSafe> _stats;
+
+    private:
+        static Node *nodeAt(Node *batch, std::size_t index) noexcept {
+            return reinterpret_cast<Node *>(reinterpret_cast<char *>(batch) +
+                                            index * kNodeAlignment);
+        }
+
+        /// allocate count nodes with one upstream allocation
+        /// \return first node. nodes are linked with next and prev in address order
+        Node *createBatch(std::size_t count) {
+            auto batch = static_cast<Node *>(
+                _upstream.allocate(count * kNodeAlignment, kNodeAlignment));
+            for (std::size_t i = 0; i < count; ++i) {
+                auto node = new (nodeAt(batch, i)) Node();
+                node->batch = batch;
+                if (i != 0) {
+                    node->prev = nodeAt(batch, i - 1);
+                    node->prev->next = node;
+                }
+            }
+            batch->batchNodeCount = count;
+            batch->emptyBatchNodeCount = count;
+            _stats.count(stats::kChunkAllocation, count);
+            return batch;
+        }
+
+        void destroyBatch(Node *batch) noexcept {
+            const auto count = batch->batchNodeCount;
+            for (std::size_t i = count; i-- > 0;) {
+                nodeAt(batch, i)->~Node();
+            }
+            _upstream.deallocate(batch, count * kNodeAlignment, kNodeAlignment);
+        }
+
+        /// \return node count of the next batch, which doubles up to the cap.
+        /// threads growing at once take successive counts.
+        std::size_t nextBatchNodeCount() noexcept {
+            auto count = _batchNodeCount.load(std::memory_order_relaxed);
+            while (count < _maxBatchNodeCount) {
+                const auto next = count * 2 < _maxBatchNodeCount ? count * 2 : _maxBatchNodeCount;
+                if (_batchNodeCount.compare_exchange_weak(count, next, std::memory_order_relaxed))
+                    break;
+            }
+            return count;
+        }
+
+        /// \return node following the batch in the list of all nodes
+        static Node *nextOfBatch(Node *batch) noexcept {
+            return nodeAt(batch, batch->batchNodeCount - 1)->next;
+        }
+
+        /// link a new batch of count nodes.
+        /// nodes of a batch are contiguous in the list of all nodes.
+        /// \return first node of the batch
+        Node *allocateNewBatch(std::size_t count) {
+            auto batch = createBatch(count);
+            auto last = nodeAt(batch, count - 1);
+
+            auto head = _allocators.load(std::memory_order_relaxed);
+            last->next = head;
+            if (head != nullptr)
+                head->prev = last;
+            _allocators.store(batch, std::memory_order_relaxed);
+            // nodes at lower addresses are used first
+            for (std::size_t i = count; i-- > 0;) {
+                detail::linkAvailable(_availableAllocators, nodeAt(batch, i));
+            }
+            _nodeCount += count;
+            _emptyNodeCount += count;
+
+            return batch;
+        }
+
+        /// \return true if enough empty nodes remain after releasing the empty batch
+        bool releasable(const Node *batch) const noexcept {
+            const auto count = batch->batchNodeCount;
+            return _emptyNodeCount - count >= _cachedEmptyNodeCount &&
+                   _nodeCount - count >= _reservedNodeCount;
+        }
+
+        /// release a batch whose nodes are all empty to the upstream
+        void releaseBatch(Node *batch) noexcept {
+            const auto count = batch->batchNodeCount;
+            for (std::size_t i = 0; i < count; ++i) {
+                auto node = nodeAt(batch, i);
+                detail::unlinkAvailable(_availableAllocators, node);
+                if (node->prev != nullptr)
+                    node->prev->next = node->next;
+                else
+                    _allocators.store(node->next, std::memory_order_relaxed);
+                if (node->next != nullptr)
+                    node->next->prev = node->prev;
+            }
+            _nodeCount -= count;
+            _emptyNodeCount -= count;
+            _stats.count(stats::kChunkRelease, count);
+
+            destroyBatch(batch);
+        }
+
+        /// link a batch of chunks shared by threads
+        void publishBatch(Node *batch) noexcept {
+            auto last = nodeAt(batch, batch->batchNodeCount - 1);
+            last->next = _allocators.load(std::memory_order_relaxed);
+            while (!_allocators.compare_exchange_weak(last->next, batch, std::memory_order_release,
+                                                      std::memory_order_relaxed)) {
+            }
+        }
+
+        /// \return node following node in the list of all nodes. the head after the tail
+        Node *nextShared(Node *node) const noexcept {
+            return node->next != nullptr ? node->next : _allocators.load(std::memory_order_acquire);
+        }
+
+        /// point allocations to a node which got free area while the hinted node is full
+        void retarget(Node *node) noexcept {
+            auto hint = _sharedHint.load(std::memory_order_relaxed);
+            if (hint != node && hint->allocator.full())
+                _sharedHint.compare_exchange_strong(hint, node, std::memory_order_release,
+                                                    std::memory_order_relaxed);
+        }
+
+        /// allocate from chunks shared by threads.
+        /// the hinted chunk serves allocations, then a few chunks from the cursor are probed,
+        /// so an allocation never walks the whole chain.
+        T *allocateShared(std::size_t n) {
+            const auto hint = _sharedHint.load(std::memory_order_acquire);
+            auto ptr = hint->allocator.allocate(n);
+            if (likely(ptr != nullptr))
+                return ptr;
+            _stats.count(stats::kFailedProbe);
+
+            // chunks of a batch are used in order
+            if (hint->next != nullptr) {
+                ptr = hint->next->allocator.allocate(n);
+                if (ptr) {
+                    _sharedHint.store(hint->next, std::memory_order_release);
+                    return ptr;
+                }
+                _stats.count(stats::kFailedProbe);
+            }
+
+            // the cursor moves on at each probe, so probes sweep every chunk over time
+            auto node = _sharedCursor.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < kSharedProbeCount; ++i) {
+                node = nextShared(node);
+                ptr = node->allocator.allocate(n);
+                if (ptr) {
+                    _sharedCursor.store(node, std::memory_order_release);
+                    _sharedHint.store(node, std::memory_order_release);
+                    return ptr;
+                }
+                _stats.count(stats::kFailedProbe);
+            }
+            _sharedCursor.store(node, std::memory_order_release);
+
+            // allocate before publishing, so the new batch is not contended
+            auto batch = createBatch(nextBatchNodeCount());
+            ptr = batch->allocator.allocate(n);
+            publishBatch(batch);
+            _sharedHint.store(batch, std::memory_order_release);
+            return ptr;
+        }
+
+        static Node *ownerOf(const T *ptr) noexcept {
+            return detail::alignedOwnerOf<Node, kNodeAlignment>(ptr);
+        }
+
+        /// allocate a large array from the upstream
+        T *allocateLarge(std::size_t n) {
+            auto ptr = static_cast<T *>(_upstream.allocate(detail::arrayBytes<T>(n), alignof(T)));
+            _stats.count(stats::kLargeAllocation, n);
+            return ptr;
+        }
+
+        void deallocateLarge(T *ptr, std::size_t n) noexcept {
+            _stats.count(stats::kLargeDeallocation, n);
+            _upstream.deallocate(ptr, n * sizeof(T), alignof(T));
+        }
+
+        /// relink a node which got free area
+        void deallocated(Node *node) noexcept {
+            if (!node->available)
+                detail::linkAvailable(_availableAllocators, node);
+
+            // keep some empty nodes, so alternate allocation and deallocation does not thrash
+            if (node->allocator.empty()) {
+                ++_emptyNodeCount;
+                auto batch = node->batch;
+                if (++batch->emptyBatchNodeCount == batch->batchNodeCount && releasable(batch))
+                    releaseBatch(batch);
+            }
+        }
+
+        static std::size_t allocateBulkFrom(AllocatorSubsystemType &allocator, T **out,
+                                            std::size_t count) {
+            return allocateBulkFrom(allocator, out, count,
+                                    detail::HasBulkAllocation<AllocatorSubsystemType>());
+        }
+
+        static std::size_t allocateBulkFrom(AllocatorSubsystemType &allocator, T **out,
+                                            std::size_t count, std::true_type) {
+            return allocator.allocate_bulk(out, count);
+        }
+
+        static std::size_t allocateBulkFrom(AllocatorSubsystemType &allocator, T **out,
+                                            std::size_t count, std::false_type) {
+            std::size_t allocated = 0;
+            for (; allocated < count; ++allocated) {
+                out[allocated] = allocator.allocate(1);
+                if (out[allocated] == nullptr)
+                    break;
+            }
+            return allocated;
+        }
+
+        static void deallocateBulkFrom(AllocatorSubsystemType &allocator, T *const *ptrs,
+                                       std::size_t count) {
+            deallocateBulkFrom(allocator, ptrs, count,
+                               detail::HasBulkAllocation<AllocatorSubsystemType>());
+        }
+
+        static void deallocateBulkFrom(AllocatorSubsystemType &allocator, T *const *ptrs,
+                                       std::size_t count, std::true_type) {
+            allocator.deallocate_bulk(ptrs, count);
+        }
+
+        static void deallocateBulkFrom(AllocatorSubsystemType &allocator, T *const *ptrs,
+                                       std::size_t count, std::false_type) {
+            for (std::size_t i = 0; i < count; ++i) {
+                allocator.deallocate(ptrs[i], 1);
+            }
+        }
+
+        static void resetChunk(AllocatorSubsystemType &allocator, std::true_type) noexcept {
+            allocator.reset();
+        }
+
+        static void resetChunk(AllocatorSubsystemType &, std::false_type) noexcept {}
+
+        /// \return allocated object count of node
+        std::size_t sizeOf(const Node *node) const noexcept {
+            // chunks of an arena are rewound lazily
+            return kMonotonic && node->epoch != _epoch ? 0 : node->allocator.size();
+        }
+
+        /// \return node at the arena cursor, which is rewound if the arena was reset after its use
+        Node *arenaNode() noexcept {
+            auto node = _cursor;
+            if (node->epoch != _epoch) {
+                resetChunk(node->allocator, detail::IsMonotonicSubsystem<AllocatorSubsystemType>());
+                node->epoch = _epoch;
+            }
+            return node;
+        }
+
+        /// move the arena cursor to the next node. a new batch is linked at the end of nodes.
+        void advanceArena() {
+            if (_cursor->prev == nullptr)
+                allocateNewBatch(nextBatchNodeCount());
+            _cursor = _cursor->prev;
+        }
+
+        /// allocate by bumping the node at the arena cursor
+        T *allocateMonotonic(std::size_t n) {
+            for (;;) {
+                auto ptr = arenaNode()->allocator.allocate(n);
+                if (ptr)
+                    return ptr;
+                _stats.count(stats::kFailedProbe);
+                advanceArena();
+            }
+        }
+
+        /// allocate objects one by one from the arena
+        void allocateBulkMonotonic(T **out, std::size_t count) {
+            for (;;) {
+                const auto allocated = allocateBulkFrom(arenaNode()->allocator, out, count);
+                out += allocated;
+                count -= allocated;
+                if (count == 0)
+                    return;
+                advanceArena();
+            }
+        }
+
+        /// allocate objects one by one from chunks shared by threads.
+        /// a bulk allocation may visit every chunk once, from the hinted chunk.
+        void allocateBulkShared(T **out, std::size_t count) {
+            const auto hint = _sharedHint.load(std::memory_order_acquire);
+            auto node = hint;
+            do {
+                const auto allocated = allocateBulkFrom(node->allocator, out, count);
+                out += allocated;
+                count -= allocated;
+                if (count == 0) {
+                    _sharedHint.store(node, std::memory_order_release);
+                    return;
+                }
+                node = nextShared(node);
+            } while (node != hint);
+
+            while (count > 0) {
+                // fill before publishing, so the new batch is not contended
+                auto batch = createBatch(nextBatchNodeCount());
+                node = batch;
+                for (std::size_t i = 0; i < batch->batchNodeCount && count > 0; ++i) {
+                    node = nodeAt(batch, i);
+                    const auto allocated = allocateBulkFrom(node->allocator, out, count);
+                    out += allocated;
+                    count -= allocated;
+                }
+                publishBatch(batch);
+                _sharedHint.store(node, std::memory_order_release);
+            }
+        }
+
+    public:
+        /// \param cachedEmptyNodeCount empty chunks kept before releasing them to the upstream.
+        /// chunks of thread safe subsystems are never released.
+        /// \param maxBatchNodeCount cap of chunks allocated at once from the upstream.
+        /// chunks are released to the upstream by the batch.
+        explicit BlockAllocator(std::size_t cachedEmptyNodeCount = kDefaultCachedEmptyNodeCount,
+                                std::size_t maxBatchNodeCount = kDefaultMaxBatchNodeCount)
+            : BlockAllocator(Upstream(), cachedEmptyNodeCount, maxBatchNodeCount) {}
+
+        /// \param upstream source of chunks
+        /// \param cachedEmptyNodeCount empty chunks kept before releasing them to the upstream.
+        /// \param maxBatchNodeCount cap of chunks allocated at once from the upstream.
+        explicit BlockAllocator(Upstream upstream,
+                                std::size_t cachedEmptyNodeCount = kDefaultCachedEmptyNodeCount,
+                                std::size_t maxBatchNodeCount = kDefaultMaxBatchNodeCount)
+            : _allocators(nullptr)
+            , _availableAllocators(nullptr)
+            , _nodeCount(0)
+            , _emptyNodeCount(0)
+            , _cachedEmptyNodeCount(cachedEmptyNodeCount)
+            , _sharedHint(nullptr)
+            , _sharedCursor(nullptr)
+            , _batchNodeCount(1)
+            , _maxBatchNodeCount(maxBatchNodeCount == 0 ? 1 : maxBatchNodeCount)
+            , _reservedNodeCount(0)
+            , _epoch(0)
+            , _cursor(nullptr)
+            , _arenaTail(nullptr)
+            , _upstream(std::move(upstream)) {
+            auto batch = allocateNewBatch(nextBatchNodeCount());
+            _cursor = _arenaTail = nodeAt(batch, batch->batchNodeCount - 1);
+            _sharedHint.store(batch, std::memory_order_relaxed);
+            _sharedCursor.store(batch, std::memory_order_relaxed);
+        }
+
+        BlockAllocator(const BlockAllocator &) = delete;
+        BlockAllocator(BlockAllocator &&) = delete;
+
+        BlockAllocator &operator=(const BlockAllocator &) = delete;
+        BlockAllocator &operator=(BlockAllocator &&) = delete;
+
+        ~BlockAllocator() {
+            auto batch = _allocators.load(std::memory_order_acquire);
+            while (batch != nullptr) {
+                auto next = nextOfBatch(batch);
+                destroyBatch(batch);
+                batch = next;
+            }
+        }
+
+    public:
+        T *allocate(std::size_t n) {
+            if (unlikely(n > kLargeThreshold))
+                return allocateLarge(n);
+
+            _stats.count(stats::kAllocation, n);
+            if (kThreadSafe)
+                return allocateShared(n);
+            if (kMonotonic)
+                return allocateMonotonic(n);
+
+            auto allocator = _availableAllocators;
+            while (allocator != nullptr) {
+                const bool wasEmpty = allocator->allocator.empty();
+                auto ptr = allocator->allocator.allocate(n);
+                if (ptr) {
+                    if (wasEmpty) {
+                        --_emptyNodeCount;
+                        --allocator->batch->emptyBatchNodeCount;
+                    }
+                    if (allocator->allocator.full())
+                        detail::unlinkAvailable(_availableAllocators, allocator);
+                    return ptr;
+                }
+
+                // free area is not continuous enough for n objects
+                _stats.count(stats::kFailedProbe);
+                allocator = allocator->nextAvailable;
+            }
+
+            auto node = allocateNewBatch(nextBatchNodeCount());
+
+            auto ptr = node->allocator.allocate(n);
+            --_emptyNodeCount;
+            --node->emptyBatchNodeCount;
+            if (node->allocator.full())
+                detail::unlinkAvailable(_availableAllocators, node);
+            return ptr;
+        }
+
+        void deallocate(T *ptr, std::size_t n) {
+            // the array length tells large arrays from objects of chunks
+            if (unlikely(n > kLargeThreshold)) {
+                deallocateLarge(ptr, n);
+                return;
+            }
+
+            _stats.count(stats::kDeallocation, n);
+            if (kMonotonic)
+                return;
+
+            auto node = ownerOf(ptr);
+            node->allocator.deallocate(ptr, n);
+            if (kThreadSafe)
+                retarget(node);
+            else
+                deallocated(node);
+        }
+
+        /// allocate count objects one by one.
+        /// many objects are taken from a chunk at once if the subsystem supports it.
+        /// \param out array which receives pointers to objects
+        /// \param count object count
+        void allocate_bulk(T **out, std::size_t count) {
+            _stats.count(stats::kAllocation, count);
+            if (kThreadSafe) {
+                allocateBulkShared(out, count);
+                return;
+            }
+            if (kMonotonic) {
+                allocateBulkMonotonic(out, count);
+                return;
+            }
+
+            while (count > 0) {
+                auto node = _availableAllocators;
+                if (node == nullptr)
+                    node = allocateNewBatch(nextBatchNodeCount());
+
+                if (node->allocator.empty()) {
+                    --_emptyNodeCount;
+                    --node->batch->emptyBatchNodeCount;
+                }
+                const auto allocated = allocateBulkFrom(node->allocator, out, count);
+                if (node->allocator.full())
+                    detail::unlinkAvailable(_availableAllocators, node);
+
+                out += allocated;
+                count -= allocated;
+            }
+        }
+
+        /// deallocate count objects one by one.
+        /// objects are grouped by their chunk, so each chunk is updated once.
+        /// \param ptrs objects to deallocate
+        /// \param count object count
+        void deallocate_bulk(T *const *ptrs, std::size_t count) {
+            _stats.count(stats::kDeallocation, count);
+            if (kMonotonic)
+                return;
+
+            if (kThreadSafe) {
+                // counts of chunks would be shared with other threads, so only consecutive
+                // objects of a chunk are freed together
+                for (std::size_t i = 0; i < count;) {
+                    auto node = ownerOf(ptrs[i]);
+                    auto last = i + 1;
+                    while (last < count && ownerOf(ptrs[last]) == node) {
+                        ++last;
+                    }
+                    deallocateBulkFrom(node->allocator, ptrs + i, last - i);
+                    retarget(node);
+                    i = last;
+                }
+                return;
+            }
+
+            // count objects of each chunk, in order of the first object of each chunk
+            std::vector<Node *> nodes;
+            bool scattered = false;
+            for (std::size_t i = 0; i < count;) {
+                auto node = ownerOf(ptrs[i]);
+                auto last = i + 1;
+                while (last < count && ownerOf(ptrs[last]) == node) {
+                    ++last;
+                }
+
+                if (node->bulkCount == 0)
+                    nodes.push_back(node);
+                else
+                    scattered = true;
+                node->bulkCount += last - i;
+                i = last;
+            }
+
+            // objects of each chunk are placed together unless they already are
+            std::vector<T *> grouped;
+            if (scattered) {
+                std::size_t offset = 0;
+                for (auto node : nodes) {
+                    node->bulkOffset = offset;
+                    offset += node->bulkCount;
+                }
+                grouped.resize(count);
+                for (std::size_t i = 0; i < count; ++i) {
+                    grouped[ownerOf(ptrs[i])->bulkOffset++] = ptrs[i];
+                }
+                ptrs = grouped.data();
+            }
+
+            for (auto node : nodes) {
+                deallocateBulkFrom(node->allocator, ptrs, node->bulkCount);
+                ptrs += node->bulkCount;
+                node->bulkCount = 0;
+                deallocated(node);
+            }
+        }
+
+        /// allocate chunks for n objects in one upstream allocation in advance.
+        /// the chunks are kept until shrink_to_fit.
+        /// \param n object count
+        void reserve(std::size_t n) {
+            constexpr auto kObjectCount = AllocatorSubsystemType::kAllocatableObjectCount;
+            const auto nodeCount = (n + kObjectCount - 1) / kObjectCount;
+            const auto currentCount = chunkCount();
+            if (nodeCount <= currentCount)
+                return;
+
+            if (kThreadSafe) {
+                publishBatch(createBatch(nodeCount - currentCount));
+                return;
+            }
+            allocateNewBatch(nodeCount - currentCount);
+            _reservedNodeCount = nodeCount;
+        }
+
+        /// release every batch of empty chunks to the upstream.
+        /// chunks of an arena are kept until destruction.
+        void shrink_to_fit() noexcept {
+            if (kThreadSafe || kMonotonic)
+                return;
+
+            _reservedNodeCount = 0;
+            auto batch = _allocators.load(std::memory_order_relaxed);
+            while (batch != nullptr) {
+                auto next = nextOfBatch(batch);
+                if (batch->emptyBatchNodeCount == batch->batchNodeCount)
+                    releaseBatch(batch);
+                batch = next;
+            }
+        }
+
+        /// \return statistics. counters are zero unless Stats is stats::Counting.
+        /// chunks of thread safe subsystems are sampled while other threads may use them.
+        stats::Snapshot stats() const {
+            constexpr auto kObjectCount = AllocatorSubsystemType::kAllocatableObjectCount;
+
+            stats::Snapshot snapshot;
+            _stats.addTo(snapshot);
+
+            std::size_t usedCapacity = 0;
+            for (auto node = _allocators.load(std::memory_order_acquire); node != nullptr;
+                 node = node->next) {
+                const auto size = sizeOf(node);
+                snapshot.occupancy.push_back(size);
+                snapshot.liveObjects += size;
+                if (size != 0)
+                    usedCapacity += kObjectCount;
+            }
+            snapshot.chunkCount = snapshot.occupancy.size();
+            snapshot.capacity = snapshot.chunkCount * kObjectCount;
+            if (usedCapacity != 0)
+                snapshot.fragmentation =
+                    static_cast<double>(usedCapacity - snapshot.liveObjects) / usedCapacity;
+            return snapshot;
+        }
+
+        /// free every object of the arena at once.
+        /// chunks are kept and rewound lazily when the arena reaches them again.
+        void reset() noexcept {
+            static_assert(kMonotonic, "reset requires a monotonic subsystem");
+            ++_epoch;
+            _cursor = _arenaTail;
+        }
+
+        /// \return chunk count
+        std::size_t chunkCount() const noexcept {
+            if (!kThreadSafe)
+                return _nodeCount;
+
+            std::size_t count = 0;
+            for (auto node = _allocators.load(std::memory_order_acquire); node != nullptr;
+                 node = node->next) {
+                ++count;
+            }
+            return count;
+        }
+    };
+
+    /// Block allocator shared by threads
+    /// Each thread allocates from chunks of its own cache without locks.
+    /// Only refilling a cache from the shared pool and spilling empty chunks back lock the pool.
+    /// Blocks freed by other threads are marked in a lock-free per-chunk bitmap,
+    /// and the owner frees them in batches at its next allocation.
+    /// \tparam T object type
+    /// \tparam Subsystem allocation subsystem of each chunk
+    /// \tparam Upstream source of chunks. it is used under the lock of the shared pool.
+    /// \tparam Stats statistics policy (stats::Disabled or stats::Counting).
+    /// each thread cache counts its own events, and they are merged into a snapshot.
+    template <class T, class Subsystem = subsystems::BitAllocationSubsystem<T>,
+              class Upstream = sources::NewDeleteSource, class Stats = stats::Disabled>
+    class ConcurrentBlockAllocator {
+    public:
+        using AllocatorSubsystemType = Subsystem;
+        using UpstreamType = Upstream;
+        static constexpr std::size_t kBlockSize = AllocatorSubsystemType::kBlockSize;
+        static constexpr bool kThreadSafe = true;
+        /// arrays of more objects than this are large.
+        /// a large array gets its own span of the upstream under the lock of the shared pool.
+        /// sources::MmapSource unmaps freed spans of kUnmapThreshold bytes or more.
+        static constexpr std::size_t kLargeThreshold =
+            AllocatorSubsystemType::kAllocatableObjectCount;
+        /// empty chunks kept by a thread cache before spilling them to the shared pool
+        static constexpr std::size_t kCachedEmptyNodeCount = 2;
+        /// empty chunks kept by default in the shared pool before releasing them to the upstream
+        static constexpr std::size_t kDefaultCachedEmptyNodeCount = 8;
+
+        using value_type = T;
+        template <class U> struct rebind {
+            using other = ConcurrentBlockAllocator<U, typename Subsystem::template rebind<U>::other,
+                                                   Upstream, Stats>;
+        };
+
+    private:
+        static constexpr std::size_t kRemoteWordCount =
+            (AllocatorSubsystemType::kAllocatableObjectCount + 63) / 64;
+
+        struct ThreadCache;
+
+        struct Node {
+            /// next node of all nodes
+            Node *next;
+            /// previous node of all nodes
+            Node *prev;
+            /// previous node of nodes which have free area
+            Node *prevAvailable;
+            /// next node of nodes which have free area
+            Node *nextAvailable;
+            bool available;
+            /// thread cache which allocates from this node. nullptr in the shared pool
+            ThreadCache *owner;
+
+            /// blocks freed by threads other than the owner
+            std::atomic<std::uint64_t> remoteFrees[kRemoteWordCount];
+            /// true while this node is in the remote free stack of the owner
+            std::atomic<bool> remoteQueued;
+            /// threads which are freeing blocks of this node
+            std::atomic<std::size_t> remoteFreeing;
+            /// next node of the remote free stack
+            Node *nextRemote;
+
+            AllocatorSubsystemType allocator;
+        };
+
+        static constexpr std::size_t kNodeAlignment = detail::ceilPowerOfTwo(sizeof(Node));
+
+        struct ThreadCache {
+            /// nodes which have free area
+            Node *availableNodes = nullptr;
+            /// empty nodes in availableNodes
+            std::size_t emptyNodeCount = 0;
+            /// next cache released by an exited thread
+            ThreadCache *nextIdle = nullptr;
+
+            /// nodes which have blocks freed by other threads (lock-free stack)
+            std::atomic<Node *> remoteNodes{nullptr};
+
+            /// events of the thread using this cache
+            typename Stats::template Recorder<false> stats;
+        };
+
+        struct SharedPool {
+            const std::uint64_t id;
+
+            std::mutex mutex;
+            /// all nodes
+            Node *nodes = nullptr;
+            /// empty nodes spilled by thread caches
+            Node *emptyNodes = nullptr;
+            std::size_t emptyNodeCount = 0;
+            /// empty nodes kept before releasing them to the upstream
+            const std::size_t cachedEmptyNodeCount;
+            /// caches released by exited threads
+            ThreadCache *idleCaches = nullptr;
+            std::vector<std::unique_ptr<ThreadCache>> caches;
+            Upstream upstream;
+            /// chunk events. counted under the lock
+            typename Stats::template Recorder<false> stats;
+
+            SharedPool(std::uint64_t poolId, std::size_t cachedEmptyCount, Upstream source)
+                : id(poolId)
+                , cachedEmptyNodeCount(cachedEmptyCount)
+                , upstream(std::move(source)) {}
+
+            SharedPool(const SharedPool &) = delete;
+            SharedPool &operator=(const SharedPool &) = delete;
+
+            ~SharedPool() {
+                auto node = nodes;
+                while (node != nullptr) {
+                    auto next = node->next;
+                    node->~Node();
+                    upstream.deallocate(node, sizeof(Node), kNodeAlignment);
+                    node = next;
+                }
+            }
+
+            ThreadCache *acquireCache() {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (idleCaches != nullptr) {
+                    auto cache = idleCaches;
+                    idleCaches = cache->nextIdle;
+                    return cache;
+                }
+                caches.emplace_back(new ThreadCache());
+                return caches.back().get();
+            }
+
+            void releaseCache(ThreadCache *cache) {
+                drainRemoteFrees(cache);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                auto node = cache->availableNodes;
+                while (node != nullptr) {
+                    auto next = node->nextAvailable;
+                    if (spillable(node))
+                        spillLocked(cache, node);
+                    node = next;
+                }
+                cache->nextIdle = idleCaches;
+                idleCaches = cache;
+            }
+
+            /// give an empty node to the cache
+            Node *refill(ThreadCache *cache) {
+                Node *node;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    node = emptyNodes;
+                    if (node != nullptr) {
+                        emptyNodes = node->nextAvailable;
+                        --emptyNodeCount;
+                    } else {
+                        node = new (upstream.allocate(sizeof(Node), kNodeAlignment)) Node();
+                        stats.count(stats::kChunkAllocation);
+                        node->next = nodes;
+                        if (nodes != nullptr)
+                            nodes->prev = node;
+                        nodes = node;
+                    }
+                }
+
+                node->owner = cache;
+                detail::linkAvailable(cache->availableNodes, node);
+                ++cache->emptyNodeCount;
+                return node;
+            }
+
+            /// \return true if node is empty and no other thread refers it
+            static bool spillable(Node *node) noexcept {
+                return node->allocator.empty() && node->remoteFreeing.load() == 0 &&
+                       !node->remoteQueued.load();
+            }
+
+            /// move an empty node of the cache to the shared pool
+            void spill(ThreadCache *cache, Node *node) {
+                std::lock_guard<std::mutex> lock(mutex);
+                spillLocked(cache, node);
+            }
+
+            void spillLocked(ThreadCache *cache, Node *node) noexcept {
+                detail::unlinkAvailable(cache->availableNodes, node);
+                --cache->emptyNodeCount;
+
+                if (emptyNodeCount >= cachedEmptyNodeCount) {
+                    releaseLocked(node);
+                    return;
+                }
+                node->owner = nullptr;
+                node->nextAvailable = emptyNodes;
+                emptyNodes = node;
+                ++emptyNodeCount;
+            }
+
+            /// allocate a large array from the upstream
+            T *allocateLarge(std::size_t n) {
+                const auto bytes = detail::arrayBytes<T>(n);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                auto ptr = static_cast<T *>(upstream.allocate(bytes, alignof(T)));
+                stats.count(stats::kLargeAllocation, n);
+                return ptr;
+            }
+
+            void deallocateLarge(T *ptr, std::size_t n) {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.count(stats::kLargeDeallocation, n);
+                upstream.deallocate(ptr, n * sizeof(T), alignof(T));
+            }
+
+            /// release an empty node to the upstream
+            void releaseLocked(Node *node) noexcept {
+                if (node->prev != nullptr)
+                    node->prev->next = node->next;
+                else
+                    nodes = node->next;
+                if (node->next != nullptr)
+                    node->next->prev = node->prev;
+
+                node->~Node();
+                upstream.deallocate(node, sizeof(Node), kNodeAlignment);
+                stats.count(stats::kChunkRelease);
+            }
+
+            /// merge counters of the shared pool and every thread cache
+            stats::Snapshot snapshot() {
+                stats::Snapshot merged;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.addTo(merged);
+                for (auto &cache : caches) {
+                    cache->stats.addTo(merged);
+                }
+                for (auto node = nodes; node != nullptr; node = node->next) {
+                    ++merged.chunkCount;
+                }
+                merged.capacity =
+                    merged.chunkCount * AllocatorSubsystemType::kAllocatableObjectCount;
+                merged.liveObjects = merged.allocations - merged.deallocations;
+                return merged;
+            }
+
+            /// release empty nodes of the cache and the shared pool to the upstream
+            void shrink(ThreadCache *cache) {
+                if (cache != nullptr)
+                    drainRemoteFrees(cache);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (cache != nullptr) {
+                    auto node = cache->availableNodes;
+                    while (node != nullptr) {
+                        auto next = node->nextAvailable;
+                        if (spillable(node)) {
+                            detail::unlinkAvailable(cache->availableNodes, node);
+                            --cache->emptyNodeCount;
+                            releaseLocked(node);
+                        }
+                        node = next;
+                    }
+                }
+
+                while (emptyNodes != nullptr) {
+                    auto next = emptyNodes->nextAvailable;
+                    releaseLocked(emptyNodes);
+                    emptyNodes = next;
+                }
+                emptyNodeCount = 0;
+            }
+
+            void deallocateLocal(ThreadCache *cache, Node *node, T *ptr, std::size_t n) {
+                cache->stats.count(stats::kDeallocation, n);
+                node->allocator.deallocate(ptr, n);
+                if (!node->available)
+                    detail::linkAvailable(cache->availableNodes, node);
+
+                if (node->allocator.empty() && ++cache->emptyNodeCount > kCachedEmptyNodeCount &&
+                    spillable(node))
+                    spill(cache, node);
+            }
+
+            /// free blocks which other threads freed, a run of blocks at once
+            void drainRemoteFrees(ThreadCache *cache) {
+                auto node = cache->remoteNodes.exchange(nullptr);
+                while (node != nullptr) {
+                    auto next = node->nextRemote;
+                    // blocks freed after this are pushed again
+                    node->remoteQueued.store(false);
+
+                    for (std::size_t word = 0; word < kRemoteWordCount; ++word) {
+                        auto bits = node->remoteFrees[word].exchange(0);
+                        while (bits != 0) {
+                            const auto head = detail::countTrailingZeros(bits);
+                            const auto rest = ~(bits >> head);
+                            const auto length = rest == 0 ? 64 : detail::countTrailingZeros(rest);
+
+                            auto ptr = reinterpret_cast<T *>(
+                                reinterpret_cast<char *>(node->allocator.data()) +
+                                (word * 64 + head) * kBlockSize);
+                            deallocateLocal(cache, node, ptr, length);
+
+                            bits &= ~(detail::lowerBits(length) << head);
+                        }
+                    }
+                    node = next;
+                }
+            }
+        };
+
+        /// last cache of the current thread. trivially destructible, so it outlives the registry
+        struct LastCache {
+            std::uint64_t id;
+            ThreadCache *cache;
+            /// true after the registry of the current thread is destroyed
+            bool exited;
+        };
+
+        /// thread caches of the current thread
+        struct CacheRegistry {
+            struct Entry {
+                std::uint64_t id;
+                std::weak_ptr<SharedPool> pool;
+                ThreadCache *cache;
+            };
+
+            LastCache &last;
+            std::vector<Entry> entries;
+
+            explicit CacheRegistry(LastCache &lastCache) noexcept
+                : last(lastCache) {}
+
+            ~CacheRegistry() {
+                last.id = 0;
+                last.cache = nullptr;
+                last.exited = true;
+                for (auto &entry : entries) {
+                    if (auto pool = entry.pool.lock())
+                        pool->releaseCache(entry.cache);
+                }
+            }
+        };
+
+    private:
+        std::shared_ptr<SharedPool> _pool;
+
+    private:
+        static std::uint64_t nextPoolId() noexcept {
+            static std::atomic<std::uint64_t> id(0);
+            return ++id;
+        }
+
+        static Node *ownerOf(const T *ptr) noexcept {
+            return detail::alignedOwnerOf<Node, kNodeAlignment>(ptr);
+        }
+
+        /// \param create create a cache if the current thread has no cache
+        /// \return cache of the current thread. nullptr if the thread is exiting
+        ThreadCache *localCache(bool create) {
+            // pool ids are never reused, so the last cache is valid while its id matches
+            static thread_local LastCache last = {0, nullptr, false};
+            if (likely(last.id == _pool->id))
+                return last.cache;
+            if (unlikely(last.exited))
+                return nullptr;
+
+            static thread_local CacheRegistry registry(last);
+            ThreadCache *cache = nullptr;
+            for (auto &entry : registry.entries) {
+                if (entry.id == _pool->id) {
+                    cache = entry.cache;
+                    break;
+                }
+            }
+
+            if (cache == nullptr) {
+                if (!create)
+                    return nullptr;
+
+                auto &entries = registry.entries;
+                for (auto it = entries.begin(); it != entries.end();) {
+                    it = it->pool.expired() ? entries.erase(it) : it + 1;
+                }
+
+                cache = _pool->acquireCache();
+                registry.entries.push_back({_pool->id, _pool, cache});
+            }
+
+            last.id = _pool->id;
+            last.cache = cache;
+            return cache;
+        }
+
+        T *allocateFrom(ThreadCache *cache, std::size_t n) {
+            if (unlikely(cache->remoteNodes.load(std::memory_order_relaxed) != nullptr))
+                _pool->drainRemoteFrees(cache);
+
+            cache->stats.count(stats::kAllocation, n);
+            auto node = cache->availableNodes;
+            T *ptr = nullptr;
+            while (node != nullptr) {
+                const bool wasEmpty = node->allocator.empty();
+                ptr = node->allocator.allocate(n);
+                if (ptr) {
+                    if (wasEmpty)
+                        --cache->emptyNodeCount;
+                    break;
+                }
+
+                // free area is not continuous enough for n objects
+                cache->stats.count(stats::kFailedProbe);
+                node = node->nextAvailable;
+            }
+
+            if (node == nullptr) {
+                node = _pool->refill(cache);
+                ptr = node->allocator.allocate(n);
+                --cache->emptyNodeCount;
+            }
+
+            if (node->allocator.full())
+                detail::unlinkAvailable(cache->availableNodes, node);
+            return ptr;
+        }
+
+    public:
+        /// \param cachedEmptyNodeCount empty chunks kept in the shared pool before releasing
+        /// them to the upstream
+        explicit ConcurrentBlockAllocator(
+            std::size_t cachedEmptyNodeCount = kDefaultCachedEmptyNodeCount)
+            : ConcurrentBlockAllocator(Upstream(), cachedEmptyNodeCount) {}
+
+        /// \param upstream source of chunks
+        /// \param cachedEmptyNodeCount empty chunks kept by the shared pool
+        explicit ConcurrentBlockAllocator(
+            Upstream upstream, std::size_t cachedEmptyNodeCount = kDefaultCachedEmptyNodeCount)
+            : _pool(std::make_shared<SharedPool>(nextPoolId(), cachedEmptyNodeCount,
+                                                 std::move(upstream))) {}
+
+        ConcurrentBlockAllocator(const ConcurrentBlockAllocator &) = delete;
+        ConcurrentBlockAllocator(ConcurrentBlockAllocator &&) = delete;
+
+        ConcurrentBlockAllocator &operator=(const ConcurrentBlockAllocator &) = delete;
+        ConcurrentBlockAllocator &operator=(ConcurrentBlockAllocator &&) = delete;
+
+        ~ConcurrentBlockAllocator() = default;
+
+    public:
+        T *allocate(std::size_t n) {
+            if (unlikely(n > kLargeThreshold))
+                return _pool->allocateLarge(n);
+
+            auto cache = localCache(true);
+            if (likely(cache != nullptr))
+                return allocateFrom(cache, n);
+
+            // destructors of thread local objects allocate after the caches are released,
+            // so borrow an idle cache for this allocation
+            cache = _pool->acquireCache();
+            T *ptr;
+            try {
+                ptr = allocateFrom(cache, n);
+            } catch (...) {
+                _pool->releaseCache(cache);
+                throw;
+            }
+            _pool->releaseCache(cache);
+            return ptr;
+        }
+
+        void deallocate(T *ptr, std::size_t n) {
+            if (unlikely(n > kLargeThreshold)) {
+                _pool->deallocateLarge(ptr, n);
+                return;
+            }
+
+            auto node = ownerOf(ptr);
+            auto cache = localCache(false);
+            if (likely(node->owner == cache)) {
+                _pool->deallocateLocal(cache, node, ptr, n);
+                return;
+            }
+
+            // mark the blocks, and the owner cache frees them at its next allocation
+            auto owner = node->owner;
+            node->remoteFreeing.fetch_add(1);
+
+            const auto first = reinterpret_cast<const char *>(node->allocator.data());
+            auto index =
+                static_cast<std::size_t>(reinterpret_cast<const char *>(ptr) - first) / kBlockSize;
+            while (n > 0) {
+                const auto offset = index % 64;
+                const auto count = n < 64 - offset ? n : 64 - offset;
+                node->remoteFrees[index / 64].fetch_or(detail::lowerBits(count) << offset);
+                index += count;
+                n -= count;
+            }
+
+            if (!node->remoteQueued.exchange(true)) {
+                auto head = owner->remoteNodes.load();
+                do {
+                    node->nextRemote = head;
+                } while (!owner->remoteNodes.compare_exchange_weak(head, node));
+            }
+            node->remoteFreeing.fetch_sub(1);
+        }
+
+        /// release empty chunks of the shared pool and the current thread to the upstream
+        void shrink_to_fit() { _pool->shrink(localCache(false)); }
+
+        /// lock the shared pool before fork, so the child does not inherit it locked by a
+        /// thread which does not exist in the child. other threads keep allocating from their
+        /// caches, and wait when they need the shared pool.
+        void lock_for_fork() { _pool->mutex.lock(); }
+
+        /// unlock the shared pool locked by lock_for_fork, in the parent and in the child
+        void unlock_after_fork() { _pool->mutex.unlock(); }
+
+        /// \return statistics. counters are zero unless Stats is stats::Counting.
+        /// chunks are owned by threads, so they are not sampled and live objects are counted.
+        /// blocks freed by other threads are counted when their owner frees them.
+        stats::Snapshot stats() const { return _pool->snapshot(); }
+    };
+
+    /// Copyable handle of block allocators shared by containers
+    /// Copies and rebound copies refer the same registry of pools, one BlockAllocator per type,
+    /// so nodes of many containers are allocated from one pool and containers move in O(1).
+    /// Arrays longer than a chunk are allocated from the upstream by the pool.
+    /// \tparam T object type
+    /// \tparam Subsystem allocation subsystem of each chunk
+    /// \tparam Upstream source of chunks
+    template <class T, class Subsystem = subsystems::BitAllocationSubsystem<T>,
+              class Upstream = sources::NewDeleteSource>
+    class SharedBlockAllocator {
+    public:
+        using PoolType = BlockAllocator<T, Subsystem, Upstream>;
+        using AllocatorSubsystemType = Subsystem;
+
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::false_type;
+
+        template <class U> struct rebind {
+            using other =
+                SharedBlockAllocator<U, typename Subsystem::template rebind<U>::other, Upstream>;
+        };
+
+        template <class U, class S, class R> friend class SharedBlockAllocator;
+
+    private:
+        std::shared_ptr<detail::PoolRegistry> _registry;
+        PoolType *_pool;
+
+    public:
+        /// create a new registry of pools
+        SharedBlockAllocator()
+            : _registry(std::make_shared<detail::PoolRegistry>())
+            , _pool(_registry->template get<PoolType>()) {}
+
+        // moves copy, so a moved-from container still refers a live pool
+        SharedBlockAllocator(const SharedBlockAllocator &) = default;
+        SharedBlockAllocator &operator=(const SharedBlockAllocator &) = default;
+
+        /// share the registry of pools
+        /// \param other allocator of any object type
+        template <class U, class S>
+        SharedBlockAllocator(const SharedBlockAllocator<U, S, Upstream> &other)
+            : _registry(other._registry)
+            , _pool(_registry->template get<PoolType>()) {}
+
+    public:
+        T *allocate(std::size_t n) { return _pool->allocate(n); }
+
+        void deallocate(T *ptr, std::size_t n) { _pool->deallocate(ptr, n); }
+
+        /// \return pool of this object type
+        PoolType &pool() const noexcept { return *_pool; }
+
+        template <class U, class S>
+        bool operator==(const SharedBlockAllocator<U, S, Upstream> &other) const noexcept {
+            return _registry == other._registry;
+        }
+
+        template <class U, class S>
+        bool operator!=(const SharedBlockAllocator<U, S, Upstream> &other) const noexcept {
+            return !(*this == other);
+        }
+    };
+
+    /// Pool of objects owned individually
+    /// make_unique and make_shared construct an object in a block of the pool,
+    /// and the object is destroyed and its block freed when the last owner releases it.
+    /// make_shared places the control block and the object in one block of a pool of the
+    /// control block type. The pool must outlive its objects, and is used by one thread at a time.
+    /// \tparam T object type
+    /// \tparam Subsystem allocation subsystem of each chunk
+    /// \tparam Upstream source of chunks
+    /// \tparam Stats statistics policy of the pool of T
+    template <class T, class Subsystem = subsystems::BitAllocationSubsystem<T>,
+              class Upstream = sources::NewDeleteSource, class Stats = stats::Disabled>
+    class ObjectPool {
+    public:
+        using PoolType = BlockAllocator<T, Subsystem, Upstream, Stats>;
+
+        /// deleter of make_unique.
+        /// the chunk of the object is found by masking its address, so the deleter holds the pool.
+        class Deleter {
+        private:
+            PoolType *_pool;
+
+        public:
+            Deleter() noexcept : _pool(nullptr) {}
+            explicit Deleter(PoolType &pool) noexcept : _pool(&pool) {}
+
+            void operator()(T *ptr) const noexcept {
+                ptr->~T();
+                _pool->deallocate(ptr, 1);
+            }
+        };
+
+        using UniquePointer = std::unique_ptr<T, Deleter>;
+
+        /// allocator of make_shared, which allocates from the pool of each type of the registry
+        template <class U> class SharedAllocator {
+        public:
+            using value_type = U;
+
+            template <class V> struct rebind { using other = SharedAllocator<V>; };
+
+            template <class V> friend class SharedAllocator;
+
+        private:
+            ObjectPool *_owner;
+
+        public:
+            explicit SharedAllocator(ObjectPool &owner) noexcept : _owner(&owner) {}
+
+            template <class V>
+            SharedAllocator(const SharedAllocator<V> &other) noexcept : _owner(other._owner) {}
+
+        public:
+            U *allocate(std::size_t n) { return _owner->template poolOf<U>().allocate(n); }
+
+            void deallocate(U *ptr, std::size_t n) {
+                _owner->template poolOf<U>().deallocate(ptr, n);
+            }
+
+            template <class V> bool operator==(const SharedAllocator<V> &other) const noexcept {
+                return _owner == other._owner;
+            }
+
+            template <class V> bool operator!=(const SharedAllocator<V> &other) const noexcept {
+                return !(*this == other);
+            }
+        };
+
+    private:
+        PoolType _pool;
+        /// pools of control blocks
+        detail::PoolRegistry _registry;
+        /// key and pool of the type allocated by make_shared last
+        const void *_sharedKey;
+        void *_sharedPool;
+
+    private:
+        /// \return pool of U, which is looked up in the registry when U changes
+        template <class U>
+        BlockAllocator<U, typename Subsystem::template rebind<U>::other, Upstream> &poolOf() {
+            using Pool = BlockAllocator<U, typename Subsystem::template rebind<U>::other, Upstream>;
+
+            const auto key = detail::typeKey<Pool>();
+            if (unlikely(_sharedKey != key)) {
+                _sharedPool = _registry.template get<Pool>();
+                _sharedKey = key;
+            }
+            return *static_cast<Pool *>(_sharedPool);
+        }
+
+    public:
+        ObjectPool()
+            : _pool()
+            , _registry()
+            , _sharedKey(nullptr)
+            , _sharedPool(nullptr) {}
+
+        ObjectPool(const ObjectPool &) = delete;
+        ObjectPool(ObjectPool &&) = delete;
+
+        ObjectPool &operator=(const ObjectPool &) = delete;
+        ObjectPool &operator=(ObjectPool &&) = delete;
+
+        ~ObjectPool() = default;
+
+    public:
+        /// construct an object in a block of the pool
+        /// \param args arguments of the constructor
+        /// \return owner of the object
+        template <class... Args> UniquePointer make_unique(Args &&... args) {
+            auto ptr = _pool.allocate(1);
+            try {
+                new (ptr) T(std::forward<Args>(args)...);
+            } catch (...) {
+                _pool.deallocate(ptr, 1);
+                throw;
+            }
+            return UniquePointer(ptr, Deleter(_pool));
+        }
+
+        /// construct an object and its control block in one block
+        /// \param args arguments of the constructor
+        /// \return owner of the object
+        template <class... Args> std::shared_ptr<T> make_shared(Args &&... args) {
+            return std::allocate_shared<T>(SharedAllocator<T>(*this), std::forward<Args>(args)...);
+        }
+
+        /// \return pool of the objects of make_unique
+        PoolType &pool() noexcept { return _pool; }
+    };
+
+    /// 32 bit fancy pointer to an object of a HandleAllocator
+    /// A handle names a chunk and a block of it, and is resolved through the chunk table of the
+    /// allocator type in O(1). Arithmetic moves between blocks of the same chunk.
+    /// \tparam T object type
+    /// \tparam Space allocator type which resolves handles
+    template <class T, class Space> class Handle {
+    public:
+        using element_type = T;
+        using value_type = typename std::remove_cv<T>::type;
+        using difference_type = std::ptrdiff_t;
+        using reference = typename std::add_lvalue_reference<T>::type;
+        using pointer = Handle;
+        using iterator_category = std::random_access_iterator_tag;
+
+        template <class U> using rebind = Handle<U, Space>;
+
+        template <class U, class S> friend class Handle;
+
+    private:
+        /// chunk id and block index. 0 is null
+        std::uint32_t _value;
+
+    public:
+        Handle() noexcept
+            : _value(0) {}
+        Handle(std::nullptr_t) noexcept
+            : _value(0) {}
+
+        /// convert a handle of U, whose pointer converts to a pointer of T implicitly
+        template <class U, typename std::enable_if<std::is_convertible<U *, T *>::value,
+                                                   int>::type = 0>
+        Handle(const Handle<U, Space> &other) noexcept
+            : _value(other._value) {}
+
+        /// cast a handle of U, such as a handle of void
+        template <class U, typename std::enable_if<!std::is_convertible<U *, T *>::value,
+                                                   int>::type = 0>
+        explicit Handle(const Handle<U, Space> &other) noexcept
+            : _value(other._value) {}
+
+    public:
+        /// \param value value of a handle
+        /// \return handle of the value
+        static Handle fromValue(std::uint32_t value) noexcept {
+            Handle handle;
+            handle._value = value;
+            return handle;
+        }
+
+        /// \param r object allocated by the allocator type
+        /// \return handle of the object
+        template <class U = T>
+        static Handle
+        pointer_to(typename std::enable_if<!std::is_void<U>::value, U>::type &r) noexcept {
+            return fromValue(Space::valueOf(std::addressof(r)));
+        }
+
+        /// \return value of this handle. 0 if this handle is null
+        std::uint32_t value() const noexcept { return _value; }
+
+        /// \return address of the object. nullptr if this handle is null
+        T *get() const noexcept {
+            return _value == 0 ? nullptr : static_cast<T *>(Space::resolve(_value));
+        }
+
+        T *operator->() const noexcept { return get(); }
+        reference operator*() const noexcept { return *get(); }
+        reference operator[](difference_type n) const noexcept { return *(*this + n); }
+
+        explicit operator bool() const noexcept { return _value != 0; }
+
+        Handle &operator++() noexcept {
+            ++_value;
+            return *this;
+        }
+        Handle operator++(int) noexcept {
+            auto copy = *this;
+            ++_value;
+            return copy;
+        }
+        Handle &operator--() noexcept {
+            --_value;
+            return *this;
+        }
+        Handle operator--(int) noexcept {
+            auto copy = *this;
+            --_value;
+            return copy;
+        }
+        Handle &operator+=(difference_type n) noexcept {
+            _value = static_cast<std::uint32_t>(_value + n);
+            return *this;
+        }
+        Handle &operator-=(difference_type n) noexcept {
+            _value = static_cast<std::uint32_t>(_value - n);
+            return *this;
+        }
+
+        friend Handle operator+(Handle handle, difference_type n) noexcept { return handle += n; }
+        friend Handle operator+(difference_type n, Handle handle) noexcept { return handle += n; }
+        friend Handle operator-(Handle handle, difference_type n) noexcept { return handle -= n; }
+        friend difference_type operator-(Handle lhs, Handle rhs) noexcept {
+            return static_cast<difference_type>(lhs._value) -
+                   static_cast<difference_type>(rhs._value);
+        }
+
+        friend bool operator==(Handle lhs, Handle rhs) noexcept { return lhs._value == rhs._value; }
+        friend bool operator!=(Handle lhs, Handle rhs) noexcept { return lhs._value != rhs._value; }
+        friend bool operator<(Handle lhs, Handle rhs) noexcept { return lhs._value < rhs._value; }
+        friend bool operator>(Handle lhs, Handle rhs) noexcept { return lhs._value > rhs._value; }
+        friend bool operator<=(Handle lhs, Handle rhs) noexcept { return lhs._value <= rhs._value; }
+        friend bool operator>=(Handle lhs, Handle rhs) noexcept { return lhs._value >= rhs._value; }
+        friend bool operator==(Handle handle, std::nullptr_t) noexcept { return !handle; }
+        friend bool operator==(std::nullptr_t, Handle handle) noexcept { return !handle; }
+        friend bool operator!=(Handle handle, std::nullptr_t) noexcept { return bool(handle); }
+        friend bool operator!=(std::nullptr_t, Handle handle) noexcept { return bool(handle); }
+    };
+
+    /// Block allocator whose pointer type is a 32 bit Handle
+    /// Links of node based structures take half the memory of pointers,
+    /// so more of a large structure fits in the cache.
+    /// Handles are resolved through a chunk table shared by the allocators of the same type.
+    /// Chunks are placed like BlockAllocator, so the handle of an object address is found in O(1).
+    /// Arrays longer than a chunk are not supported.
+    /// Standard containers which assume raw pointers, such as std::list of libstdc++, cannot use
+    /// this allocator. Use handles as links of your own node structures.
+    /// \tparam T object type
+    /// \tparam Subsystem allocation subsystem of each chunk
+    /// \tparam Upstream source of chunks
+    template <class T, class Subsystem = subsystems::BitAllocationSubsystem<T>,
+              class Upstream = sources::NewDeleteSource>
+    class HandleAllocator {
+    public:
+        using AllocatorSubsystemType = Subsystem;
+        using UpstreamType = Upstream;
+        static constexpr std::size_t kBlockSize = AllocatorSubsystemType::kBlockSize;
+        /// bits of a handle which index a block of a chunk. one past the last block fits
+        static constexpr std::size_t kSlotBits =
+            detail::bitWidth(AllocatorSubsystemType::kAllocatableObjectCount);
+        /// chunks which handles can name at once. id 0 is the null handle
+        static constexpr std::size_t kMaxChunkCount = (std::size_t(1) << (32 - kSlotBits)) - 1;
+        /// empty chunks kept before releasing them to the upstream
+        static constexpr std::size_t kCachedEmptyNodeCount = 1;
+
+        using value_type = T;
+        using pointer = Handle<T, HandleAllocator>;
+        using const_pointer = Handle<const T, HandleAllocator>;
+        using void_pointer = Handle<void, HandleAllocator>;
+        using const_void_pointer = Handle<const void, HandleAllocator>;
+
+        template <class U> struct rebind {
+            using other =
+                HandleAllocator<U, typename Subsystem::template rebind<U>::other, Upstream>;
+        };
+
+        template <class U, class S> friend class Handle;
+
+    private:
+        static_assert(kSlotBits <= 20, "chunks have too many objects for 32 bit handles");
+
+        struct Node {
+            /// next node of all nodes
+            Node *next;
+            /// previous node of all nodes
+            Node *prev;
+            /// previous node of nodes which have free area
+            Node *prevAvailable;
+            /// next node of nodes which have free area
+            Node *nextAvailable;
+            bool available;
+            /// id of this node in the chunk table
+            std::uint32_t id;
+            AllocatorSubsystemType allocator;
+        };
+
+        static constexpr std::size_t kNodeAlignment = detail::ceilPowerOfTwo(sizeof(Node));
+
+        static constexpr std::size_t kIdBits = 32 - kSlotBits;
+        static constexpr std::size_t kSegmentBits = kIdBits < 12 ? kIdBits : 12;
+        static constexpr std::size_t kSegmentSize = std::size_t(1) << kSegmentBits;
+        static constexpr std::size_t kSegmentCount = std::size_t(1) << (kIdBits - kSegmentBits);
+
+        union Entry {
+            /// first block of the chunk
+            char *data;
+            /// next unused id. valid while the id is unused
+            std::uint32_t nextFree;
+        };
+
+        /// chunks of all allocators of this type.
+        /// segments are never moved nor freed, so handles are resolved without locks.
+        struct Table {
+            std::mutex mutex;
+            Entry *segments[kSegmentCount] = {};
+            /// ids used at least once
+            std::uint32_t usedCount = 0;
+            /// first unused id released by a chunk. 0 if none
+            std::uint32_t freeId = 0;
+        };
+
+        static Table _table;
+
+    private:
+        Upstream _upstream;
+        /// all nodes
+        Node *_nodes;
+        /// nodes which have free area
+        Node *_availableNodes;
+        /// empty nodes in _availableNodes
+        std::size_t _emptyNodeCount;
+
+    private:
+        static Entry &entryOf(std::uint32_t id) noexcept {
+            return _table.segments[id >> kSegmentBits][id & (kSegmentSize - 1)];
+        }
+
+        static void *resolve(std::uint32_t value) noexcept {
+            return entryOf(value >> kSlotBits).data +
+                   (value & ((std::uint32_t(1) << kSlotBits) - 1)) * kBlockSize;
+        }
+
+        static std::uint32_t valueOf(Node *node, const void *ptr) noexcept {
+            const auto index = static_cast<std::uint32_t>(
+                (static_cast<const char *>(ptr) -
+                 reinterpret_cast<const char *>(node->allocator.data())) /
+                kBlockSize);
+            return (node->id << kSlotBits) | index;
+        }
+
+        static std::uint32_t valueOf(const void *ptr) noexcept {
+            return valueOf(detail::alignedOwnerOf<Node, kNodeAlignment>(ptr), ptr);
+        }
+
+        /// \return id of the chunk
+        static std::uint32_t registerChunk(char *data) {
+            std::lock_guard<std::mutex> lock(_table.mutex);
+            auto id = _table.freeId;
+            if (id != 0) {
+                _table.freeId = entryOf(id).nextFree;
+            } else {
+                if (_table.usedCount == kMaxChunkCount)
+                    throw std::bad_alloc();
+                id = ++_table.usedCount;
+                auto &segment = _table.segments[id >> kSegmentBits];
+                if (segment == nullptr)
+                    segment = new Entry[kSegmentSize]();
+            }
+            entryOf(id).data = data;
+            return id;
+        }
+
+        static void unregisterChunk(std::uint32_t id) noexcept {
+            std::lock_guard<std::mutex> lock(_table.mutex);
+            entryOf(id).nextFree = _table.freeId;
+            _table.freeId = id;
+        }
+
+        Node *createNode() {
+            auto node = new (_upstream.allocate(sizeof(Node), kNodeAlignment)) Node();
+            try {
+                node->id = registerChunk(reinterpret_cast<char *>(node->allocator.data()));
+            } catch (...) {
+                node->~Node();
+                _upstream.deallocate(node, sizeof(Node), kNodeAlignment);
+                throw;
+            }
+
+            node->next = _nodes;
+            if (_nodes != nullptr)
+                _nodes->prev = node;
+            _nodes = node;
+            detail::linkAvailable(_availableNodes, node);
+            return node;
+        }
+
+        void destroyNode(Node *node) noexcept {
+            unregisterChunk(node->id);
+            node->~Node();
+            _upstream.deallocate(node, sizeof(Node), kNodeAlignment);
+        }
+
+        void releaseNode(Node *node) noexcept {
+            detail::unlinkAvailable(_availableNodes, node);
+            if (node->prev != nullptr)
+                node->prev->next = node->next;
+            else
+                _nodes = node->next;
+            if (node->next != nullptr)
+                node->next->prev = node->prev;
+            destroyNode(node);
+        }
+
+    public:
+        HandleAllocator()
+            : HandleAllocator(Upstream()) {}
+
+        /// \param upstream source of chunks
+        explicit HandleAllocator(Upstream upstream)
+            : _upstream(std::move(upstream))
+            , _nodes(nullptr)
+            , _availableNodes(nullptr)
+            , _emptyNodeCount(0) {}
+
+        HandleAllocator(const HandleAllocator &) = delete;
+        HandleAllocator(HandleAllocator &&) = delete;
+
+        HandleAllocator &operator=(const HandleAllocator &) = delete;
+        HandleAllocator &operator=(HandleAllocator &&) = delete;
+
+        ~HandleAllocator() {
+            while (_nodes != nullptr) {
+                auto next = _nodes->next;
+                destroyNode(_nodes);
+                _nodes = next;
+            }
+        }
+
+    public:
+        pointer allocate(std::size_t n) {
+            if (unlikely(n > AllocatorSubsystemType::kAllocatableObjectCount))
+                throw std::bad_alloc();
+
+            T *ptr = nullptr;
+            auto node = _availableNodes;
+            for (; node != nullptr; node = node->nextAvailable) {
+                const bool wasEmpty = node->allocator.empty();
+                ptr = node->allocator.allocate(n);
+                if (ptr) {
+                    if (wasEmpty)
+                        --_emptyNodeCount;
+                    break;
+                }
+            }
+            if (ptr == nullptr) {
+                node = createNode();
+                ptr = node->allocator.allocate(n);
+            }
+
+            if (node->allocator.full())
+                detail::unlinkAvailable(_availableNodes, node);
+            return pointer::fromValue(valueOf(node, ptr));
+        }
+
+        void deallocate(pointer ptr, std::size_t n) {
+            auto object = ptr.get();
+            auto node = detail::alignedOwnerOf<Node, kNodeAlignment>(object);
+            node->allocator.deallocate(object, n);
+            if (!node->available)
+                detail::linkAvailable(_availableNodes, node);
+
+            if (node->allocator.empty()) {
+                if (_emptyNodeCount < kCachedEmptyNodeCount)
+                    ++_emptyNodeCount;
+                else
+                    releaseNode(node);
+            }
+        }
+    };
+
+    template <class T, class Subsystem, class Upstream>
+    typename HandleAllocator<T, Subsystem, Upstream>::Table
+        HandleAllocator<T, Subsystem, Upstream>::_table;
+
+    /// binary allocation traces.
+    /// a trace is a Header followed by Events in sequence order, in native byte order.
+    namespace trace {
+        constexpr char kMagic[8] = {'B', 'L', 'K', 'T', 'R', 'A', 'C', 'E'};
+        constexpr std::uint32_t kVersion = 1;
+
+        struct Header {
+            char magic[8];
+            std::uint32_t version;
+            /// bytes of an object
+            std::uint32_t objectSize;
+            /// alignment of an object
+            std::uint32_t objectAlignment;
+            std::uint32_t reserved;
+        };
+
+        enum Kind : std::uint8_t { kAllocate, kDeallocate };
+
+        struct Event {
+            /// order of the event among events of all threads
+            std::uint64_t sequence;
+            /// allocated or deallocated address
+            std::uint64_t address;
+            /// object count
+            std::uint32_t count;
+            /// thread numbered in order of its first event
+            std::uint16_t thread;
+            /// Kind
+            std::uint8_t kind;
+            std::uint8_t reserved;
+        };
+
+        /// \return number of the current thread
+        inline std::uint16_t threadNumber() noexcept {
+            static std::atomic<std::uint16_t> next(0);
+            static thread_local std::uint16_t number = next.fetch_add(1, std::memory_order_relaxed);
+            return number;
+        }
+    } // namespace trace
+
+    /// Allocator which records allocation and deallocation events as a binary trace.
+    /// Events are buffered, and written when the buffer is full, at flush and at destruction.
+    /// \tparam Allocator recorded allocator (BlockAllocator or ConcurrentBlockAllocator)
+    template <class Allocator> class RecordingAllocator {
+    public:
+        using AllocatorType = Allocator;
+        using value_type = typename Allocator::value_type;
+        static constexpr bool kThreadSafe = Allocator::kThreadSafe;
+        /// events buffered before writing them
+        static constexpr std::size_t kBufferedEventCount = 4096;
+
+    private:
+        std::ostream &_out;
+        /// locked only if the allocator is thread safe
+        std::mutex _mutex;
+        std::vector<trace::Event> _events;
+        std::uint64_t _sequence;
+        Allocator _allocator;
+
+    private:
+        void record(trace::Kind kind, const value_type *ptr, std::size_t n) {
+            std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+            if (kThreadSafe)
+                lock.lock();
+
+            trace::Event event;
+            event.sequence = _sequence++;
+            event.address = reinterpret_cast<std::uintptr_t>(ptr);
+            event.count = static_cast<std::uint32_t>(n);
+            event.thread = trace::threadNumber();
+            event.kind = kind;
+            event.reserved = 0;
+            _events.push_back(event);
+            if (unlikely(_events.size() == kBufferedEventCount))
+                write();
+        }
+
+        void write() {
+            _out.write(reinterpret_cast<const char *>(_events.data()),
+                       static_cast<std::streamsize>(_events.size() * sizeof(trace::Event)));
+            _events.clear();
+        }
+
+    public:
+        /// write the trace header
+        /// \param out binary stream which receives the trace
+        /// \param args arguments of the recorded allocator
+        template <class... Args>
+        explicit RecordingAllocator(std::ostream &out, Args &&... args)
+            : _out(out)
+            , _mutex()
+            , _events()
+            , _sequence(0)
+            , _allocator(std::forward<Args>(args)...) {
+            trace::Header header;
+            for (std::size_t i = 0; i < sizeof(header.magic); ++i) {
+                header.magic[i] = trace::kMagic[i];
+            }
+            header.version = trace::kVersion;
+            header.objectSize = sizeof(value_type);
+            header.objectAlignment = alignof(value_type);
+            header.reserved = 0;
+            _out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            _events.reserve(kBufferedEventCount);
+        }
+
+        RecordingAllocator(const RecordingAllocator &) = delete;
+        RecordingAllocator(RecordingAllocator &&) = delete;
+
+        RecordingAllocator &operator=(const RecordingAllocator &) = delete;
+        RecordingAllocator &operator=(RecordingAllocator &&) = delete;
+
+        ~RecordingAllocator() { flush(); }
+
+    public:
+        value_type *allocate(std::size_t n) {
+            auto ptr = _allocator.allocate(n);
+            record(trace::kAllocate, ptr, n);
+            return ptr;
+        }
+
+        void deallocate(value_type *ptr, std::size_t n) {
+            // recorded first, so the area is not reallocated before this event
+            record(trace::kDeallocate, ptr, n);
+            _allocator.deallocate(ptr, n);
+        }
+
+        /// write buffered events
+        void flush() {
+            std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+            if (kThreadSafe)
+                lock.lock();
+            write();
+            _out.flush();
+        }
+
+        /// \return recorded allocator
+        Allocator &allocator() noexcept { return _allocator; }
+    };
+
+#ifdef BLACK_HAS_MEMORY_RESOURCE
+    namespace detail {
+        /// ascending block sizes of size classes. multiples of 8
+        template <std::size_t... Sizes> struct SizeClassList {
+            static constexpr std::size_t kSizes[] = {Sizes...};
+            static constexpr std::size_t kCount = sizeof...(Sizes);
+        };
+
+        /// \return table from (bytes + 7) / 8 to the smallest size class not less than bytes
+        template <class List, std::size_t MaxSize>
+        constexpr std::array<std::uint8_t, MaxSize / 8 + 1> makeClassTable() noexcept {
+            std::array<std::uint8_t, MaxSize / 8 + 1> table{};
+            std::size_t sizeClass = 0;
+            for (std::size_t i = 0; i < table.size(); ++i) {
+                while (List::kSizes[sizeClass] < i * 8) {
+                    ++sizeClass;
+                }
+                table[i] = static_cast<std::uint8_t>(sizeClass);
+            }
+            return table;
+        }
+    } // namespace detail
+
+    /// Small object pool for any size
+    /// Requests up to kMaxBlockSize bytes are rounded up to a size class,
+    /// and each size class allocates blocks from its own BlockAllocator.
+    /// Larger or over-aligned requests are passed to the upstream resource.
+    /// This resource is not thread safe, like std::pmr::unsynchronized_pool_resource.
+    class PoolResource : public std::pmr::memory_resource {
+    public:
+        static constexpr std::size_t kMaxBlockSize = 512;
+
+    private:
+        static constexpr std::size_t kMaxAlignment = alignof(std::max_align_t);
+        /// chunk size of every size class. some bytes are left for the chunk header
+        static constexpr std::size_t kChunkSize = 16384;
+        static constexpr std::size_t kChunkHeaderSize = 1024;
+
+        /// raw block of a size class. aligned to the lowest set bit of Size
+        template <std::size_t Size>
+        struct alignas((Size & (~Size + 1)) < kMaxAlignment ? (Size & (~Size + 1))
+                                                            : kMaxAlignment) Block {
+            unsigned char data[Size];
+        };
+
+        template <std::size_t Size>
+        using ClassAllocator =
+            BlockAllocator<Block<Size>,
+                           subsystems::HierarchicalBitAllocationSubsystem<
+                               Block<Size>, (kChunkSize - kChunkHeaderSize) / Size>,
+                           sources::MemoryResourceSource>;
+
+        /// 4 classes for each power of two
+        using SizeClasses = detail::SizeClassList<8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128,
+                                                  160, 192, 224, 256, 320, 384, 448, 512>;
+        static constexpr std::size_t kClassCount = SizeClasses::kCount;
+
+        template <std::size_t... Sizes>
+        static std::tuple<ClassAllocator<Sizes>...> allocatorsOf(detail::SizeClassList<Sizes...>);
+        using Allocators = decltype(allocatorsOf(SizeClasses()));
+
+        struct SizeClass {
+            void *allocator;
+            void *(*allocate)(void *allocator);
+            void (*deallocate)(void *allocator, void *ptr);
+        };
+
+        static constexpr auto kClassTable =
+            detail::makeClassTable<SizeClasses, kMaxBlockSize>();
+
+    private:
+        std::pmr::memory_resource *_upstream;
+        Allocators _allocators;
+        SizeClass _classes[kClassCount];
+
+    private:
+        template <std::size_t... Indices>
+        PoolResource(std::pmr::memory_resource *upstream, std::index_sequence<Indices...>)
+            : _upstream(upstream)
+            , _allocators(((void)Indices, sources::MemoryResourceSource(upstream))...)
+            , _classes{makeSizeClass(std::get<Indices>(_allocators))...} {}
+
+        template <class Allocator> static SizeClass makeSizeClass(Allocator &allocator) noexcept {
+            return {&allocator,
+                    [](void *self) -> void * {
+                        return static_cast<Allocator *>(self)->allocate(1);
+                    },
+                    [](void *self, void *ptr) {
+                        static_cast<Allocator *>(self)->deallocate(
+                            static_cast<typename Allocator::value_type *>(ptr), 1);
+                    }};
+        }
+
+        /// \return size class of the request. kClassCount if the upstream serves it
+        static std::size_t classOf(std::size_t bytes, std::size_t alignment) noexcept {
+            if (unlikely(alignment > kMaxAlignment))
+                return kClassCount;
+            // a class whose size is a multiple of the alignment is aligned enough
+            bytes = (bytes + alignment - 1) & ~(alignment - 1);
+            if (unlikely(bytes > kMaxBlockSize))
+                return kClassCount;
+            return kClassTable[(bytes + 7) / 8];
+        }
+
+    protected:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+            const auto sizeClass = classOf(bytes, alignment);
+            if (sizeClass == kClassCount)
+                return _upstream->allocate(bytes, alignment);
+
+            auto &entry = _classes[sizeClass];
+            return entry.allocate(entry.allocator);
+        }
+
+        void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override {
+            const auto sizeClass = classOf(bytes, alignment);
+            if (sizeClass == kClassCount) {
+                _upstream->deallocate(ptr, bytes, alignment);
+                return;
+            }
+
+            auto &entry = _classes[sizeClass];
+            entry.deallocate(entry.allocator, ptr);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+            return this == &other;
+        }
+
+    public:
+        /// \param upstream source of chunks and of large requests
+        explicit PoolResource(
+            std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+            : PoolResource(upstream, std::make_index_sequence<kClassCount>()) {}
+
+        PoolResource(const PoolResource &) = delete;
+        PoolResource &operator=(const PoolResource &) = delete;
+
+        ~PoolResource() override = default;
+
+        std::pmr::memory_resource *upstream_resource() const noexcept { return _upstream; }
+
+        /// release empty chunks of every size class to the upstream
+        void shrink_to_fit() noexcept {
+            std::apply([](auto &... allocators) { (allocators.shrink_to_fit(), ...); },
+                       _allocators);
+        }
+    };
+#endif
 } // namespace black
 
 #ifdef _likely_black_defined
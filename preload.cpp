@@ -0,0 +1,425 @@
+//   Copyright 2019 SiLeader and Cerussite.
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// malloc and operator new replacement for LD_PRELOAD
+//   LD_PRELOAD=libblack-preload.so program
+// Requests up to kMaxSmallSize bytes are served by a ConcurrentBlockAllocator of each size class.
+// Chunks of a size class are carved out of its own part of one reserved region,
+// so free finds the size class of a pointer from its address in O(1).
+// Other requests, and requests made while black itself allocates, go to glibc malloc.
+// Shared pools of all size classes are locked across fork, so a child never inherits a pool
+// locked by a thread which does not exist in the child.
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <utility>
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "black.hpp"
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace {
+    constexpr std::size_t kMaxSmallSize = 256;
+    constexpr std::size_t kAlignment = 16;
+    /// address space reserved for the chunks of each size class
+    constexpr std::size_t kClassRegionSize = std::size_t(1) << 30u;
+    /// chunk size of every size class. some bytes are left for the chunk header
+    constexpr std::size_t kChunkSize = 65536;
+    constexpr std::size_t kChunkHeaderSize = 2048;
+
+    /// chunk source of a size class which bumps a pointer in its part of the region
+    /// It is used under the lock of the shared pool of the size class.
+    class RegionSource {
+    private:
+        struct FreeSpan {
+            FreeSpan *next;
+        };
+
+    private:
+        char *_current;
+        char *_end;
+        /// released chunks. every chunk of a size class has the same size
+        FreeSpan *_freeSpans;
+
+    public:
+        RegionSource(char *begin, char *end) noexcept
+            : _current(begin)
+            , _end(end)
+            , _freeSpans(nullptr) {}
+
+        void *allocate(std::size_t bytes, std::size_t alignment) {
+            if (_freeSpans != nullptr) {
+                auto span = _freeSpans;
+                _freeSpans = span->next;
+                return span;
+            }
+
+            auto head = reinterpret_cast<char *>(
+                (reinterpret_cast<std::uintptr_t>(_current) + alignment - 1) & ~(alignment - 1));
+            if (head + bytes > _end)
+                throw std::bad_alloc();
+            _current = head + bytes;
+            return head;
+        }
+
+        void deallocate(void *ptr, std::size_t bytes, std::size_t) noexcept {
+            // return the pages to the system, but keep the address for the next chunk
+            ::madvise(ptr, bytes, MADV_DONTNEED);
+            auto span = static_cast<FreeSpan *>(ptr);
+            span->next = _freeSpans;
+            _freeSpans = span;
+        }
+    };
+
+    template <std::size_t Size> struct alignas(kAlignment) Block {
+        unsigned char data[Size];
+    };
+
+    template <std::size_t Size>
+    using ClassAllocator = black::ConcurrentBlockAllocator<
+        Block<Size>,
+        black::subsystems::HierarchicalBitAllocationSubsystem<
+            Block<Size>, (kChunkSize - kChunkHeaderSize) / Size>,
+        RegionSource>;
+
+    template <std::size_t... Sizes> struct SizeClassList {
+        static constexpr std::size_t kSizes[] = {Sizes...};
+        static constexpr std::size_t kCount = sizeof...(Sizes);
+    };
+
+    using SizeClasses =
+        SizeClassList<16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, kMaxSmallSize>;
+    constexpr std::size_t kClassCount = SizeClasses::kCount;
+
+    struct SizeClass {
+        void *allocator;
+        void *(*allocate)(void *allocator);
+        void (*deallocate)(void *allocator, void *ptr);
+        void (*lock)(void *allocator);
+        void (*unlock)(void *allocator);
+    };
+
+    template <std::size_t... Sizes>
+    std::tuple<ClassAllocator<Sizes>...> allocatorsOf(SizeClassList<Sizes...>);
+    using Allocators = decltype(allocatorsOf(SizeClasses()));
+
+    /// \return table from (size + 15) / 16 to size class
+    constexpr std::array<std::uint8_t, kMaxSmallSize / kAlignment + 1> makeClassTable() noexcept {
+        std::array<std::uint8_t, kMaxSmallSize / kAlignment + 1> table{};
+        std::size_t sizeClass = 0;
+        for (std::size_t i = 0; i < table.size(); ++i) {
+            while (SizeClasses::kSizes[sizeClass] < i * kAlignment) {
+                ++sizeClass;
+            }
+            table[i] = static_cast<std::uint8_t>(sizeClass);
+        }
+        return table;
+    }
+
+    constexpr auto kClassTable = makeClassTable();
+
+    /// size classes. never destroyed, so memory is freed after static destructors
+    struct Heap {
+        char *region;
+        Allocators allocators;
+        SizeClass classes[kClassCount];
+
+        template <std::size_t... Indices>
+        Heap(char *begin, std::index_sequence<Indices...>)
+            : region(begin)
+            , allocators(RegionSource(begin + Indices * kClassRegionSize,
+                                      begin + (Indices + 1) * kClassRegionSize)...)
+            , classes{makeSizeClass(std::get<Indices>(allocators))...} {}
+
+        template <class Allocator> static SizeClass makeSizeClass(Allocator &allocator) noexcept {
+            return {&allocator,
+                    [](void *self) -> void * {
+                        return static_cast<Allocator *>(self)->allocate(1);
+                    },
+                    [](void *self, void *ptr) {
+                        static_cast<Allocator *>(self)->deallocate(
+                            static_cast<typename Allocator::value_type *>(ptr), 1);
+                    },
+                    [](void *self) { static_cast<Allocator *>(self)->lock_for_fork(); },
+                    [](void *self) { static_cast<Allocator *>(self)->unlock_after_fork(); }};
+        }
+    };
+
+    enum class State { Uninitialized, Initializing, Ready, Failed };
+
+    std::atomic<State> state(State::Uninitialized);
+    Heap *heap = nullptr;
+    std::aligned_storage<sizeof(Heap), alignof(Heap)>::type heapStorage;
+
+    /// true while black allocates in the current thread, so nested requests go to glibc
+    __attribute__((tls_model("initial-exec"))) thread_local bool reentered = false;
+
+    class ReentrancyGuard {
+    public:
+        ReentrancyGuard() noexcept { reentered = true; }
+        ~ReentrancyGuard() { reentered = false; }
+    };
+
+    /// lock every shared pool in order of size classes before fork
+    void lockForFork() noexcept {
+        for (auto &sizeClass : heap->classes) {
+            sizeClass.lock(sizeClass.allocator);
+        }
+    }
+
+    /// unlock the shared pools in the parent, and in the child, where the forking thread
+    /// still owns them
+    void unlockAfterFork() noexcept {
+        for (std::size_t i = kClassCount; i > 0; --i) {
+            auto &sizeClass = heap->classes[i - 1];
+            sizeClass.unlock(sizeClass.allocator);
+        }
+    }
+
+    /// \return true if black serves requests
+    bool ready() noexcept {
+        auto current = state.load(std::memory_order_acquire);
+        if (current == State::Ready)
+            return true;
+        if (current != State::Uninitialized ||
+            !state.compare_exchange_strong(current, State::Initializing))
+            return false;
+
+        // other threads use glibc while this thread initializes the heap
+        auto region = ::mmap(nullptr, kClassCount * kClassRegionSize, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED) {
+            state.store(State::Failed, std::memory_order_release);
+            return false;
+        }
+
+        try {
+            ReentrancyGuard guard;
+            heap = new (&heapStorage)
+                Heap(static_cast<char *>(region), std::make_index_sequence<kClassCount>());
+            if (::pthread_atfork(lockForFork, unlockAfterFork, unlockAfterFork) != 0)
+                throw std::bad_alloc();
+        } catch (...) {
+            ::munmap(region, kClassCount * kClassRegionSize);
+            state.store(State::Failed, std::memory_order_release);
+            return false;
+        }
+        state.store(State::Ready, std::memory_order_release);
+        return true;
+    }
+
+    /// \return size class of the pointer. kClassCount if glibc allocated it
+    std::size_t classOf(const void *ptr) noexcept {
+        if (state.load(std::memory_order_acquire) != State::Ready)
+            return kClassCount;
+        const auto offset = reinterpret_cast<std::uintptr_t>(ptr) -
+                            reinterpret_cast<std::uintptr_t>(heap->region);
+        return offset < kClassCount * kClassRegionSize ? offset / kClassRegionSize : kClassCount;
+    }
+
+    /// \return allocated area. nullptr if black does not serve the request
+    void *allocateSmall(std::size_t size) noexcept {
+        if (size > kMaxSmallSize || reentered || !ready())
+            return nullptr;
+
+        ReentrancyGuard guard;
+        auto &sizeClass = heap->classes[kClassTable[(size + kAlignment - 1) / kAlignment]];
+        try {
+            return sizeClass.allocate(sizeClass.allocator);
+        } catch (...) {
+            return nullptr;
+        }
+    }
+
+    void *allocate(std::size_t size) noexcept {
+        auto ptr = allocateSmall(size);
+        return ptr != nullptr ? ptr : __libc_malloc(size);
+    }
+
+    void deallocate(void *ptr) noexcept {
+        const auto sizeClass = classOf(ptr);
+        if (sizeClass == kClassCount) {
+            __libc_free(ptr);
+            return;
+        }
+
+        const bool nested = reentered;
+        reentered = true;
+        auto &entry = heap->classes[sizeClass];
+        entry.deallocate(entry.allocator, ptr);
+        reentered = nested;
+    }
+
+    void *allocateAligned(std::size_t alignment, std::size_t size) noexcept {
+        if (alignment <= kAlignment)
+            return allocate(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void *allocateOrThrow(std::size_t size) {
+        for (;;) {
+            auto ptr = allocate(size);
+            if (ptr != nullptr)
+                return ptr;
+
+            auto handler = std::get_new_handler();
+            if (handler == nullptr)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    void *allocateAlignedOrThrow(std::size_t alignment, std::size_t size) {
+        for (;;) {
+            auto ptr = allocateAligned(alignment, size);
+            if (ptr != nullptr)
+                return ptr;
+
+            auto handler = std::get_new_handler();
+            if (handler == nullptr)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+} // namespace
+
+extern "C" {
+void *malloc(std::size_t size) { return allocate(size); }
+
+void free(void *ptr) {
+    if (ptr != nullptr)
+        deallocate(ptr);
+}
+
+void *calloc(std::size_t count, std::size_t size) {
+    if (size != 0 && count > static_cast<std::size_t>(-1) / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+
+    // chunks are reused, so small areas are cleared
+    auto ptr = allocateSmall(count * size);
+    if (ptr == nullptr)
+        return __libc_calloc(count, size);
+    std::memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void *realloc(void *ptr, std::size_t size) {
+    if (ptr == nullptr)
+        return allocate(size);
+
+    const auto sizeClass = classOf(ptr);
+    if (sizeClass == kClassCount)
+        return __libc_realloc(ptr, size);
+    if (size == 0) {
+        deallocate(ptr);
+        return nullptr;
+    }
+
+    const auto blockSize = SizeClasses::kSizes[sizeClass];
+    if (size <= blockSize)
+        return ptr;
+
+    auto newPtr = allocate(size);
+    if (newPtr == nullptr)
+        return nullptr;
+    std::memcpy(newPtr, ptr, blockSize);
+    deallocate(ptr);
+    return newPtr;
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) {
+    return allocateAligned(alignment, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) {
+    return allocateAligned(alignment, size);
+}
+
+int posix_memalign(void **ptr, std::size_t alignment, std::size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    auto allocated = allocateAligned(alignment, size);
+    if (allocated == nullptr)
+        return ENOMEM;
+    *ptr = allocated;
+    return 0;
+}
+
+std::size_t malloc_usable_size(void *ptr) {
+    if (ptr == nullptr)
+        return 0;
+
+    const auto sizeClass = classOf(ptr);
+    if (sizeClass != kClassCount)
+        return SizeClasses::kSizes[sizeClass];
+
+    using UsableSize = std::size_t (*)(void *);
+    static UsableSize usableSize = nullptr;
+    if (usableSize == nullptr) {
+        ReentrancyGuard guard;
+        usableSize = reinterpret_cast<UsableSize>(::dlsym(RTLD_NEXT, "malloc_usable_size"));
+    }
+    return usableSize(ptr);
+}
+}
+
+void *operator new(std::size_t size) { return allocateOrThrow(size); }
+void *operator new[](std::size_t size) { return allocateOrThrow(size); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return allocateAlignedOrThrow(static_cast<std::size_t>(alignment), size);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocateAlignedOrThrow(static_cast<std::size_t>(alignment), size);
+}
+void *operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+    return allocateAligned(static_cast<std::size_t>(alignment), size);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+    return allocateAligned(static_cast<std::size_t>(alignment), size);
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept { free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept { free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { free(ptr); }
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept { free(ptr); }
@@ -0,0 +1,454 @@
+//   Copyright 2019 SiLeader and Cerussite.
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// Replay a trace of black::RecordingAllocator against allocators.
+//
+//   black-replay trace.bin
+//
+// Events of all threads are replayed by one thread in sequence order.
+// Each allocator runs in a new process which loads only the operation list of the trace,
+// so its peak resident memory is measured alone.
+// Arrays longer than a chunk are allocated from the upstream by each allocator.
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "black.hpp"
+
+namespace {
+    /// event whose address is replaced by a slot of the pointer table
+    struct Operation {
+        std::uint32_t slot;
+        std::uint32_t count;
+        bool allocate;
+    };
+
+    struct Trace {
+        black::trace::Header header;
+        std::vector<Operation> operations;
+        /// deallocations of objects which are live at the end of the trace
+        std::vector<Operation> leftovers;
+        /// live objects at most
+        std::size_t slotCount;
+        std::size_t allocationCount;
+        /// deallocations whose allocation is not in the trace
+        std::size_t unmatchedCount;
+    };
+
+    struct Result {
+        double operationsPerSecond;
+        double p50;
+        double p99;
+        double p999;
+        /// peak resident memory grown by the replay
+        long peakKiB;
+    };
+
+    bool load(const char *path, Trace &trace) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.read(reinterpret_cast<char *>(&trace.header), sizeof(trace.header)) ||
+            std::memcmp(trace.header.magic, black::trace::kMagic, sizeof(trace.header.magic)) !=
+                0 ||
+            trace.header.version != black::trace::kVersion) {
+            std::cerr << path << ": not a trace of this version" << std::endl;
+            return false;
+        }
+
+        std::vector<black::trace::Event> events;
+        black::trace::Event event;
+        while (in.read(reinterpret_cast<char *>(&event), sizeof(event))) {
+            events.push_back(event);
+        }
+        std::stable_sort(events.begin(), events.end(),
+                         [](const black::trace::Event &lhs, const black::trace::Event &rhs) {
+                             return lhs.sequence < rhs.sequence;
+                         });
+
+        // an address is live from its allocation to its deallocation
+        std::unordered_map<std::uint64_t, Operation> slots;
+        std::vector<std::uint32_t> freeSlots;
+        trace.slotCount = 0;
+        trace.allocationCount = 0;
+        trace.unmatchedCount = 0;
+        for (auto &e : events) {
+            if (e.kind == black::trace::kAllocate) {
+                std::uint32_t slot;
+                if (freeSlots.empty()) {
+                    slot = static_cast<std::uint32_t>(trace.slotCount++);
+                } else {
+                    slot = freeSlots.back();
+                    freeSlots.pop_back();
+                }
+                slots[e.address] = {slot, e.count, false};
+                trace.operations.push_back({slot, e.count, true});
+                ++trace.allocationCount;
+                continue;
+            }
+
+            auto it = slots.find(e.address);
+            if (it == slots.end()) {
+                ++trace.unmatchedCount;
+                continue;
+            }
+            trace.operations.push_back({it->second.slot, e.count, false});
+            freeSlots.push_back(it->second.slot);
+            slots.erase(it);
+        }
+        for (auto &live : slots) {
+            trace.leftovers.push_back(live.second);
+        }
+        return true;
+    }
+
+    /// write operations of a trace for replay processes
+    bool saveOperations(const char *path, const Trace &trace) {
+        std::ofstream out(path, std::ios::binary);
+        const std::uint64_t counts[] = {trace.slotCount, trace.operations.size(),
+                                        trace.leftovers.size()};
+        out.write(reinterpret_cast<const char *>(&trace.header), sizeof(trace.header));
+        out.write(reinterpret_cast<const char *>(counts), sizeof(counts));
+        out.write(reinterpret_cast<const char *>(trace.operations.data()),
+                  trace.operations.size() * sizeof(Operation));
+        out.write(reinterpret_cast<const char *>(trace.leftovers.data()),
+                  trace.leftovers.size() * sizeof(Operation));
+        return static_cast<bool>(out.flush());
+    }
+
+    /// read operations written by saveOperations.
+    /// buffers are read in place, so no freed memory is left resident before the replay.
+    bool loadOperations(const char *path, Trace &trace) {
+        std::ifstream in(path, std::ios::binary);
+        std::uint64_t counts[3];
+        if (!in.read(reinterpret_cast<char *>(&trace.header), sizeof(trace.header)) ||
+            !in.read(reinterpret_cast<char *>(counts), sizeof(counts)))
+            return false;
+        trace.slotCount = counts[0];
+        trace.operations.resize(counts[1]);
+        trace.leftovers.resize(counts[2]);
+        return static_cast<bool>(
+            in.read(reinterpret_cast<char *>(trace.operations.data()),
+                    trace.operations.size() * sizeof(Operation)) &&
+            in.read(reinterpret_cast<char *>(trace.leftovers.data()),
+                    trace.leftovers.size() * sizeof(Operation)));
+    }
+
+    /// forget the peak resident memory of this process.
+    /// \return false if the peak cannot be reset
+    bool resetPeakResident() {
+        // "5" resets the high-water mark of the resident set (Linux)
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        return static_cast<bool>(clearRefs << "5" << std::flush);
+    }
+
+    /// \return peak resident memory of this process in KiB
+    long peakResidentKiB() {
+        // ru_maxrss is kept across exec, while VmHWM belongs to the current image
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0)
+                return std::strtol(line.c_str() + 6, nullptr, 10);
+        }
+
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    /// allocate or deallocate objects of an operation
+    template <class Allocator>
+    void apply(Allocator &allocator, const Operation &operation,
+               std::vector<typename Allocator::value_type *> &pointers) {
+        auto &ptr = pointers[operation.slot];
+        if (operation.allocate)
+            ptr = allocator.allocate(operation.count);
+        else
+            allocator.deallocate(ptr, operation.count);
+    }
+
+    /// replay operations on a new allocator
+    /// \param latencies nanoseconds of each operation. nullptr not to measure them
+    /// \return seconds of the replay
+    template <class Allocator>
+    double run(const Trace &trace, std::vector<typename Allocator::value_type *> &pointers,
+               std::uint32_t *latencies) {
+        Allocator allocator;
+        auto begin = std::chrono::steady_clock::now();
+        for (auto &operation : trace.operations) {
+            if (latencies == nullptr) {
+                apply(allocator, operation, pointers);
+                continue;
+            }
+
+            auto operationBegin = std::chrono::steady_clock::now();
+            apply(allocator, operation, pointers);
+            *latencies++ = static_cast<std::uint32_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - operationBegin)
+                    .count());
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        // objects which are live at the end of the trace
+        for (auto &operation : trace.leftovers) {
+            apply(allocator, operation, pointers);
+        }
+        return std::chrono::duration<double>(end - begin).count();
+    }
+
+    template <class Allocator> Result replay(const Trace &trace) {
+        using T = typename Allocator::value_type;
+
+        // touch buffers before measuring memory
+        std::vector<T *> pointers(trace.slotCount);
+        std::vector<std::uint32_t> latencies(trace.operations.size());
+        const bool reset = resetPeakResident();
+        const auto baseKiB = peakResidentKiB();
+
+        // memory is the peak of the timed pass alone
+        Result result;
+        result.operationsPerSecond =
+            trace.operations.size() / run<Allocator>(trace, pointers, nullptr);
+        result.peakKiB = reset ? peakResidentKiB() - baseKiB : -1;
+
+        run<Allocator>(trace, pointers, latencies.data());
+        std::sort(latencies.begin(), latencies.end());
+        const auto percentile = [&latencies](double rank) -> double {
+            if (latencies.empty())
+                return 0;
+            return latencies[static_cast<std::size_t>(rank * (latencies.size() - 1))];
+        };
+        result.p50 = percentile(0.5);
+        result.p99 = percentile(0.99);
+        result.p999 = percentile(0.999);
+        return result;
+    }
+
+    /// replayed allocators. a replay process selects one by its index
+    const char *const kAllocatorNames[] = {"std::allocator", "Bit", "LinkedList",
+                                           "Hierarchical"};
+
+    /// object of the recorded size
+    template <std::size_t Size, std::size_t Alignment> struct alignas(Alignment) Object {
+        char bytes[Size];
+    };
+
+    template <class T> bool replayAllocator(const Trace &trace, int allocator, Result &result) {
+        switch (allocator) {
+        case 0:
+            result = replay<std::allocator<T>>(trace);
+            return true;
+        case 1:
+            result = replay<black::BlockAllocator<T, black::subsystems::BitAllocationSubsystem<T>>>(
+                trace);
+            return true;
+        case 2:
+            result = replay<
+                black::BlockAllocator<T, black::subsystems::LinkedListAllocationSubsystem<T, 64>>>(
+                trace);
+            return true;
+        case 3:
+            result = replay<black::BlockAllocator<
+                T, black::subsystems::HierarchicalBitAllocationSubsystem<T, 4096>>>(trace);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /// size class a trace is replayed at. size 0 if objects of the trace are not supported
+    struct SizeClass {
+        std::size_t size;
+        std::size_t alignment;
+    };
+
+    constexpr std::size_t kMaxObjectSize = 512;
+
+    /// \return the smallest size class holding objects of the trace: 1, 2, 4 or 8 bytes aligned to
+    ///         their size, else a multiple of 8 bytes aligned to 8 or of 16 bytes aligned to 16
+    SizeClass sizeClass(const black::trace::Header &header) {
+        const std::size_t size = header.objectSize != 0 ? header.objectSize : 1;
+        const std::size_t alignment = header.objectAlignment != 0 ? header.objectAlignment : 1;
+        if (size > kMaxObjectSize || alignment > 16)
+            return {0, 0};
+        if (size <= 8 && alignment <= 8) {
+            std::size_t small = 1;
+            while (small < size || small < alignment)
+                small *= 2;
+            return {small, small};
+        }
+        const std::size_t step = alignment <= 8 ? 8 : 16;
+        return {(size + step - 1) / step * step, step};
+    }
+
+    using Replayer = bool (*)(const Trace &, int, Result &);
+
+    template <std::size_t Step, std::size_t... I>
+    constexpr std::array<Replayer, sizeof...(I)> replayers(std::index_sequence<I...>) {
+        return {{&replayAllocator<Object<(I + 1) * Step, Step>>...}};
+    }
+
+    /// replayers of size classes by size / step - 1
+    constexpr auto kReplayers8 = replayers<8>(std::make_index_sequence<kMaxObjectSize / 8>());
+    constexpr auto kReplayers16 = replayers<16>(std::make_index_sequence<kMaxObjectSize / 16>());
+
+    bool replayBySize(const Trace &trace, int allocator, Result &result) {
+        const auto objects = sizeClass(trace.header);
+        switch (objects.alignment) {
+        case 1:
+            return replayAllocator<Object<1, 1>>(trace, allocator, result);
+        case 2:
+            return replayAllocator<Object<2, 2>>(trace, allocator, result);
+        case 4:
+            return replayAllocator<Object<4, 4>>(trace, allocator, result);
+        case 8:
+            return kReplayers8[objects.size / 8 - 1](trace, allocator, result);
+        case 16:
+            return kReplayers16[objects.size / 16 - 1](trace, allocator, result);
+        default:
+            return false;
+        }
+    }
+
+    /// replay process: black-replay --replay operations.bin allocator fd
+    int replayMain(char **argv) {
+        Trace trace;
+        Result result;
+        if (!loadOperations(argv[2], trace) ||
+            !replayBySize(trace, std::atoi(argv[3]), result))
+            return 1;
+        const auto written = write(std::atoi(argv[4]), &result, sizeof(result));
+        return written == sizeof(result) ? 0 : 1;
+    }
+
+    /// run replay in a new process
+    /// \return false if the process failed
+    bool replayInChild(const char *self, const char *operations, int allocator, Result &result) {
+        int fds[2];
+        if (pipe(fds) != 0)
+            return false;
+
+        const auto pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            auto allocatorArgument = std::to_string(allocator);
+            auto fdArgument = std::to_string(fds[1]);
+            const char *args[] = {self,
+                                  "--replay",
+                                  operations,
+                                  allocatorArgument.c_str(),
+                                  fdArgument.c_str(),
+                                  nullptr};
+            execvp(self, const_cast<char *const *>(args));
+            _exit(1);
+        }
+
+        close(fds[1]);
+        const auto read = pid > 0 ? ::read(fds[0], &result, sizeof(result)) : -1;
+        close(fds[0]);
+        int status = 0;
+        if (pid > 0)
+            waitpid(pid, &status, 0);
+        return read == sizeof(result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    void reportAll(const char *self, const char *operations) {
+        std::printf("%-16s %12s %10s %10s %10s %14s\n", "allocator", "Mops/s", "p50 ns",
+                    "p99 ns", "p99.9 ns", "peak RSS KiB");
+        for (int allocator = 0; allocator < static_cast<int>(std::size(kAllocatorNames));
+             ++allocator) {
+            const auto name = kAllocatorNames[allocator];
+            Result result;
+            if (!replayInChild(self, operations, allocator, result)) {
+                std::printf("%-16s failed\n", name);
+                continue;
+            }
+            std::printf("%-16s %12.2f %10.0f %10.0f %10.0f ", name,
+                        result.operationsPerSecond / 1e6, result.p50, result.p99, result.p999);
+            if (result.peakKiB < 0)
+                std::printf("%14s\n", "unknown");
+            else
+                std::printf("%14ld\n", result.peakKiB);
+        }
+    }
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc == 5 && std::strcmp(argv[1], "--replay") == 0)
+        return replayMain(argv);
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " trace.bin" << std::endl;
+        return 2;
+    }
+
+    Trace trace;
+    if (!load(argv[1], trace))
+        return 1;
+
+    std::printf("%zu events, %zu allocations, %zu live objects at most, %u bytes per object\n",
+                trace.operations.size(), trace.allocationCount, trace.slotCount,
+                trace.header.objectSize);
+    if (trace.unmatchedCount != 0)
+        std::printf("%zu deallocations without allocation are skipped\n", trace.unmatchedCount);
+
+    const auto objects = sizeClass(trace.header);
+    if (objects.size == 0) {
+        std::cerr << "objects larger than 512 bytes or aligned to more than 16 are not supported"
+                  << std::endl;
+        return 1;
+    }
+    if (objects.size != trace.header.objectSize ||
+        objects.alignment != trace.header.objectAlignment)
+        std::printf("objects of %u bytes aligned to %u are replayed as %zu bytes aligned to %zu\n",
+                    trace.header.objectSize, trace.header.objectAlignment, objects.size,
+                    objects.alignment);
+
+    // replay processes load the operations without the events and the address map
+    const char *directory = std::getenv("TMPDIR");
+    std::string operations = std::string(directory != nullptr ? directory : "/tmp") +
+                             "/black-replay-XXXXXX";
+    const auto fd = mkstemp(&operations[0]);
+    if (fd < 0) {
+        std::cerr << operations << ": cannot create" << std::endl;
+        return 1;
+    }
+    close(fd);
+    if (!saveOperations(operations.c_str(), trace)) {
+        std::cerr << operations << ": cannot write" << std::endl;
+        unlink(operations.c_str());
+        return 1;
+    }
+
+    // buffers written before forking would be written by each replay process too
+    std::fflush(stdout);
+    reportAll(argv[0], operations.c_str());
+    unlink(operations.c_str());
+    return 0;
+}
@@ -14,11 +14,29 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
 #include <forward_list>
 #include <list>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "black.hpp"
 
+#ifdef BLACK_HAS_MMAP
+#include <sys/wait.h>
+#endif
+
 namespace {
     TEST(object, single) {
         black::BlockAllocator<int> allocator;
@@ -42,6 +60,382 @@ namespace {
         EXPECT_NE(p3, p1);
     }
 
+    TEST(feature, releaseEmptyChunk) {
+        using Allocator = black::BlockAllocator<int>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        // one chunk per upstream allocation
+        Allocator allocator(2, 1);
+
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount * 5; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+        EXPECT_EQ(allocator.chunkCount(), 5);
+
+        for (auto ptr : pointers) {
+            allocator.deallocate(ptr, 1);
+        }
+        // two empty chunks are kept
+        EXPECT_EQ(allocator.chunkCount(), 2);
+
+        allocator.shrink_to_fit();
+        EXPECT_EQ(allocator.chunkCount(), 0);
+        EXPECT_NE(allocator.allocate(1), nullptr);
+        EXPECT_EQ(allocator.chunkCount(), 1);
+    }
+
+    TEST(feature, geometricGrowth) {
+        using Allocator = black::BlockAllocator<int>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator;
+        Allocator capped(1, 2);
+        for (std::size_t i = 0; i <= kCount; ++i) {
+            allocator.allocate(1);
+            capped.allocate(1);
+        }
+        // 1 + 2 chunks
+        EXPECT_EQ(allocator.chunkCount(), 3);
+        EXPECT_EQ(capped.chunkCount(), 3);
+
+        for (std::size_t i = 0; i < kCount * 2; ++i) {
+            allocator.allocate(1);
+            capped.allocate(1);
+        }
+        // 1 + 2 + 4 chunks, and 1 + 2 + 2 chunks
+        EXPECT_EQ(allocator.chunkCount(), 7);
+        EXPECT_EQ(capped.chunkCount(), 5);
+    }
+
+    TEST(feature, reserve) {
+        using Allocator = black::BlockAllocator<int>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator;
+        allocator.reserve(kCount * 100);
+        EXPECT_EQ(allocator.chunkCount(), 100);
+
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount * 100; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+        EXPECT_EQ(allocator.chunkCount(), 100);
+
+        // reserved chunks are kept until shrink_to_fit
+        for (auto ptr : pointers) {
+            allocator.deallocate(ptr, 1);
+        }
+        EXPECT_EQ(allocator.chunkCount(), 100);
+
+        allocator.shrink_to_fit();
+        EXPECT_EQ(allocator.chunkCount(), 0);
+    }
+
+    TEST(feature, arena) {
+        using Allocator =
+            black::BlockAllocator<int, black::subsystems::MonotonicAllocationSubsystem<int>>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator;
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount * 10; ++i) {
+            pointers.push_back(allocator.allocate(1));
+            *pointers.back() = static_cast<int>(i);
+        }
+        std::vector<int *> bulk(kCount * 2 + 3);
+        allocator.allocate_bulk(bulk.data(), bulk.size());
+        pointers.insert(pointers.end(), bulk.begin(), bulk.end());
+        EXPECT_EQ(std::set<int *>(pointers.begin(), pointers.end()).size(), pointers.size());
+
+        // deallocate does not free anything
+        allocator.deallocate(pointers.front(), 1);
+        EXPECT_EQ(*pointers[1], 1);
+        const auto chunkCount = allocator.chunkCount();
+
+        // chunks are kept and reused in the same order after reset
+        allocator.reset();
+        for (std::size_t i = 0; i < kCount * 10; ++i) {
+            EXPECT_EQ(allocator.allocate(1), pointers[i]);
+        }
+        allocator.allocate_bulk(bulk.data(), bulk.size());
+        EXPECT_TRUE(std::equal(bulk.begin(), bulk.end(), pointers.begin() + kCount * 10));
+        EXPECT_EQ(allocator.chunkCount(), chunkCount);
+
+        allocator.shrink_to_fit();
+        EXPECT_EQ(allocator.chunkCount(), chunkCount);
+    }
+
+    TEST(stats, counting) {
+        using Allocator =
+            black::BlockAllocator<int, black::subsystems::LinkedListAllocationSubsystem<int, 64>,
+                                  black::sources::NewDeleteSource, black::stats::Counting>;
+
+        Allocator allocator;
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < 64 * 3; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+        for (std::size_t i = 0; i < pointers.size(); i += 2) {
+            allocator.deallocate(pointers[i], 1);
+        }
+
+        auto stats = allocator.stats();
+        EXPECT_EQ(stats.allocations, 64 * 3);
+        EXPECT_EQ(stats.deallocations, 32 * 3);
+        EXPECT_EQ(stats.chunkAllocations, 3);
+        EXPECT_EQ(stats.chunkCount, 3);
+        EXPECT_EQ(stats.capacity, 64 * 3);
+        EXPECT_EQ(stats.liveObjects, 32 * 3);
+        EXPECT_EQ(stats.occupancy, std::vector<std::size_t>(3, 32));
+        EXPECT_DOUBLE_EQ(stats.fragmentation, 0.5);
+
+        // no chunk has two continuous free blocks
+        auto array = allocator.allocate(2);
+        stats = allocator.stats();
+        EXPECT_EQ(stats.failedProbes, 3);
+        EXPECT_EQ(stats.chunkAllocations, 3 + 4);
+        EXPECT_EQ(stats.liveObjects, 32 * 3 + 2);
+        EXPECT_DOUBLE_EQ(stats.fragmentation, (64 * 4 - (32 * 3 + 2)) / 256.0);
+
+        allocator.deallocate(array, 2);
+        for (std::size_t i = 1; i < pointers.size(); i += 2) {
+            allocator.deallocate(pointers[i], 1);
+        }
+        allocator.shrink_to_fit();
+        stats = allocator.stats();
+        EXPECT_EQ(stats.chunkReleases, 7);
+        EXPECT_EQ(stats.chunkCount, 0);
+        EXPECT_EQ(stats.liveObjects, 0);
+
+        // chunks are sampled without counting
+        black::BlockAllocator<int> disabled;
+        disabled.allocate(1);
+        stats = disabled.stats();
+        EXPECT_EQ(stats.allocations, 0);
+        EXPECT_EQ(stats.liveObjects, 1);
+    }
+
+    TEST(stats, concurrent) {
+        using Allocator =
+            black::ConcurrentBlockAllocator<int, black::subsystems::BitAllocationSubsystem<int>,
+                                            black::sources::NewDeleteSource,
+                                            black::stats::Counting>;
+        Allocator allocator;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&allocator] {
+                std::vector<int *> pointers;
+                for (int i = 0; i < 1000; ++i) {
+                    pointers.push_back(allocator.allocate(1));
+                }
+                for (auto ptr : pointers) {
+                    allocator.deallocate(ptr, 1);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        // counters of every thread are merged
+        auto stats = allocator.stats();
+        EXPECT_EQ(stats.allocations, 4000);
+        EXPECT_EQ(stats.deallocations, 4000);
+        EXPECT_EQ(stats.liveObjects, 0);
+        EXPECT_GT(stats.chunkAllocations, 0);
+
+        std::vector<int *> pointers;
+        for (int i = 0; i < 100; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+        std::thread([&allocator, &pointers] {
+            for (auto ptr : pointers) {
+                allocator.deallocate(ptr, 1);
+            }
+        }).join();
+
+        // blocks freed by the other thread are counted when the owner frees them
+        EXPECT_EQ(allocator.stats().liveObjects, 100);
+        allocator.deallocate(allocator.allocate(1), 1);
+        EXPECT_EQ(allocator.stats().liveObjects, 0);
+    }
+
+    template <class Allocator> void testBulk() {
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        // keep empty chunks
+        Allocator allocator(1000);
+        auto single = allocator.allocate(1);
+
+        std::vector<int *> pointers(kCount * 10 + 3);
+        allocator.allocate_bulk(pointers.data(), pointers.size());
+        std::set<int *> unique(pointers.begin(), pointers.end());
+        unique.insert(single);
+        EXPECT_EQ(unique.size(), pointers.size() + 1);
+
+        for (std::size_t i = 0; i < pointers.size(); ++i) {
+            *pointers[i] = static_cast<int>(i);
+        }
+        for (std::size_t i = 0; i < pointers.size(); ++i) {
+            EXPECT_EQ(*pointers[i], i);
+        }
+
+        // objects of chunks are interleaved
+        const auto chunkCount = allocator.chunkCount();
+        std::shuffle(pointers.begin(), pointers.end(), std::mt19937(0));
+        allocator.deallocate_bulk(pointers.data(), pointers.size());
+        allocator.deallocate(single, 1);
+
+        // freed blocks are reused without new chunks
+        std::vector<int *> reused(pointers.size() + 1);
+        allocator.allocate_bulk(reused.data(), reused.size());
+        EXPECT_EQ(std::set<int *>(reused.begin(), reused.end()).size(), reused.size());
+        EXPECT_EQ(allocator.chunkCount(), chunkCount);
+    }
+
+    TEST(bulk, bit) { testBulk<black::BlockAllocator<int>>(); }
+
+    TEST(bulk, linkedList) {
+        using Subsystem = black::subsystems::LinkedListAllocationSubsystem<int, 64>;
+        testBulk<black::BlockAllocator<int, Subsystem>>();
+    }
+
+    TEST(bulk, hierarchical) {
+        testBulk<black::BlockAllocator<
+            int, black::subsystems::HierarchicalBitAllocationSubsystem<int, 1000>>>();
+    }
+
+    TEST(bulk, atomic) {
+        testBulk<
+            black::BlockAllocator<int, black::subsystems::AtomicBitAllocationSubsystem<int>>>();
+    }
+
+    /// check the first object of each chunk is aligned to Alignment
+    template <class Allocator, std::size_t Alignment> void testLayout() {
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator;
+        for (std::size_t chunk = 0; chunk < 3; ++chunk) {
+            auto first = allocator.allocate(1);
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(first) % Alignment, 0u);
+            for (std::size_t i = 1; i < kCount; ++i) {
+                allocator.allocate(1);
+            }
+        }
+    }
+
+    TEST(layout, cacheLine) {
+        namespace subsystems = black::subsystems;
+        using Layout = black::layouts::CacheLine;
+
+        testLayout<black::BlockAllocator<int, subsystems::BitAllocationSubsystem<int, Layout>>,
+                   64>();
+        testLayout<black::BlockAllocator<
+                       int, subsystems::LinkedListAllocationSubsystem<int, 30, Layout>>,
+                   64>();
+        testLayout<black::BlockAllocator<
+                       int, subsystems::HierarchicalBitAllocationSubsystem<int, 100, Layout>>,
+                   64>();
+        testLayout<
+            black::BlockAllocator<int, subsystems::AtomicBitAllocationSubsystem<int, Layout>>,
+            64>();
+        testLayout<black::BlockAllocator<
+                       int, subsystems::MonotonicAllocationSubsystem<int, 64, Layout>>,
+                   64>();
+        testLayout<
+            black::ConcurrentBlockAllocator<int, subsystems::BitAllocationSubsystem<int, Layout>>,
+            64>();
+    }
+
+    TEST(layout, page) {
+        using Subsystem = black::subsystems::HierarchicalBitAllocationSubsystem<
+            int, 1000, black::layouts::Page>;
+        testLayout<black::BlockAllocator<int, Subsystem>, 4096>();
+    }
+
+    TEST(layout, overAligned) {
+        struct alignas(128) Line {
+            char bytes[128];
+        };
+
+        black::BlockAllocator<Line> allocator;
+        std::vector<Line *> pointers;
+        for (std::size_t i = 0; i < 200; ++i) {
+            pointers.push_back(allocator.allocate(i % 3 + 1));
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(pointers.back()) % alignof(Line), 0u);
+        }
+        for (std::size_t i = 0; i < pointers.size(); ++i) {
+            allocator.deallocate(pointers[i], i % 3 + 1);
+        }
+    }
+
+    /// object whose chunks are tuned by a specialization of ChunkGeometry
+    struct Tuned {
+        char bytes[24];
+    };
+} // namespace
+
+namespace black {
+    template <> struct ChunkGeometry<Tuned> : geometry::Fit<Tuned, 65536> {};
+} // namespace black
+
+namespace {
+    /// object of Size bytes
+    template <std::size_t Size> struct Object {
+        char bytes[Size];
+    };
+
+    /// check a chunk holds all objects of the subsystem within the chunk size of its geometry
+    template <class Subsystem> void testGeometry() {
+        using T = typename Subsystem::value_type;
+        using Allocator = black::BlockAllocator<T, Subsystem>;
+        EXPECT_LE(Allocator::kChunkSize, black::ChunkGeometry<T>::kChunkSize);
+
+        Allocator allocator;
+        std::vector<T *> pointers;
+        for (std::size_t i = 0; i < Subsystem::kAllocatableObjectCount; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+        EXPECT_EQ(allocator.chunkCount(), 1u);
+        for (auto pointer : pointers) {
+            allocator.deallocate(pointer, 1);
+        }
+    }
+
+    template <class T> void testGeometryOf() {
+        namespace subsystems = black::subsystems;
+        testGeometry<subsystems::BitAllocationSubsystem<T>>();
+        testGeometry<subsystems::LinkedListAllocationSubsystem<T>>();
+        testGeometry<subsystems::HierarchicalBitAllocationSubsystem<T>>();
+        testGeometry<subsystems::AtomicBitAllocationSubsystem<T>>();
+        testGeometry<subsystems::MonotonicAllocationSubsystem<T>>();
+    }
+
+    TEST(geometry, objectSizes) {
+        testGeometryOf<char>();
+        testGeometryOf<Object<24>>();
+        testGeometryOf<Object<200>>();
+        testGeometryOf<Object<1000>>();
+        testGeometryOf<Object<5000>>();
+
+        // a bitmap word holds fewer objects if a chunk of half the size wastes less
+        EXPECT_LT(black::subsystems::BitAllocationSubsystem<Object<24>>::kAllocatableObjectCount,
+                  64u);
+    }
+
+    TEST(geometry, specialization) {
+        using Subsystem = black::subsystems::HierarchicalBitAllocationSubsystem<Tuned>;
+        using Allocator = black::BlockAllocator<Tuned, Subsystem>;
+        EXPECT_EQ(Allocator::kChunkSize, 65536u);
+        EXPECT_GT(Subsystem::kAllocatableObjectCount,
+                  black::subsystems::HierarchicalBitAllocationSubsystem<
+                      Object<24>>::kAllocatableObjectCount *
+                      8);
+        testGeometry<Subsystem>();
+    }
+
     TEST(array, single) {
         black::BlockAllocator<int> allocator;
 
@@ -75,6 +469,385 @@ namespace {
         }
     }
 
+    TEST(feature, deallocateOwner) {
+        using Allocator = black::BlockAllocator<int>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator;
+
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount * 5; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+
+        // object in the oldest chunk
+        allocator.deallocate(pointers.front(), 1);
+
+        bool reused = false;
+        for (std::size_t i = 0; i < kCount && !reused; ++i) {
+            reused = allocator.allocate(1) == pointers.front();
+        }
+        EXPECT_TRUE(reused);
+    }
+
+    TEST(feature, reuseFullChunk) {
+        using Allocator = black::BlockAllocator<int>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator;
+
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount * 5; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+
+        // every chunk is full, so the freed area is the only one
+        allocator.deallocate(pointers[kCount * 2], 1);
+        EXPECT_EQ(allocator.allocate(1), pointers[kCount * 2]);
+    }
+
+    TEST(array, fragmented) {
+        using Allocator = black::BlockAllocator<int>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator;
+
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+        allocator.deallocate(pointers[3], 1);
+        for (std::size_t i = 10; i < 15; ++i) {
+            allocator.deallocate(pointers[i], 1);
+        }
+
+        EXPECT_EQ(allocator.allocate(5), pointers[10]);
+        EXPECT_EQ(allocator.allocate(1), pointers[3]);
+    }
+
+    TEST(array, large) {
+        using Allocator = black::BlockAllocator<int, black::subsystems::BitAllocationSubsystem<int>,
+                                                black::sources::NewDeleteSource,
+                                                black::stats::Counting>;
+        constexpr auto kCount = Allocator::kLargeThreshold;
+
+        Allocator allocator;
+
+        auto chunk = allocator.allocate(kCount);
+        EXPECT_NE(chunk, nullptr);
+        EXPECT_EQ(allocator.chunkCount(), 1u);
+
+        // large arrays do not use chunks
+        auto large = allocator.allocate(kCount * 10);
+        for (std::size_t i = 0; i < kCount * 10; ++i) {
+            large[i] = static_cast<int>(i);
+        }
+        EXPECT_EQ(allocator.chunkCount(), 1u);
+        auto stats = allocator.stats();
+        EXPECT_EQ(stats.largeAllocations, kCount * 10);
+        EXPECT_EQ(stats.allocations, kCount);
+        EXPECT_EQ(stats.failedProbes, 0u);
+
+        allocator.deallocate(large, kCount * 10);
+        allocator.deallocate(chunk, kCount);
+        EXPECT_EQ(allocator.stats().largeDeallocations, kCount * 10);
+
+        EXPECT_THROW(allocator.allocate(~std::size_t() / 2), std::bad_alloc);
+    }
+
+    TEST(concurrent, large) {
+        black::ConcurrentBlockAllocator<int> allocator;
+        constexpr auto kCount = black::ConcurrentBlockAllocator<int>::kLargeThreshold + 1;
+
+        std::thread threads[2];
+        for (auto &thread : threads) {
+            thread = std::thread([&allocator] {
+                for (int i = 0; i < 100; ++i) {
+                    auto large = allocator.allocate(kCount);
+                    large[kCount - 1] = i;
+                    allocator.deallocate(large, kCount);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    TEST(hierarchical, object) {
+        using Subsystem = black::subsystems::HierarchicalBitAllocationSubsystem<int, 1000>;
+
+        Subsystem subsystem;
+
+        std::set<int *> pointers;
+        for (std::size_t i = 0; i < Subsystem::kAllocatableObjectCount; ++i) {
+            EXPECT_TRUE(pointers.insert(subsystem.allocate(1)).second);
+        }
+        EXPECT_TRUE(subsystem.full());
+        EXPECT_EQ(subsystem.allocate(1), nullptr);
+
+        auto ptr = *pointers.rbegin();
+        EXPECT_TRUE(subsystem.deallocate(ptr, 1));
+        EXPECT_EQ(subsystem.allocate(1), ptr);
+    }
+
+    TEST(hierarchical, arrayAcrossWords) {
+        using Subsystem = black::subsystems::HierarchicalBitAllocationSubsystem<int, 4096>;
+
+        Subsystem subsystem;
+
+        auto first = subsystem.allocate(60);
+        EXPECT_NE(first, nullptr);
+        EXPECT_EQ(subsystem.allocate(10), first + 60);
+        EXPECT_EQ(subsystem.allocate(200), first + 70);
+        EXPECT_EQ(subsystem.allocate(1), first + 270);
+
+        EXPECT_TRUE(subsystem.deallocate(first + 60, 10));
+        EXPECT_EQ(subsystem.allocate(8), first + 60);
+        EXPECT_EQ(subsystem.allocate(3), first + 271);
+    }
+
+    TEST(linkedList, coalesce) {
+        using Subsystem = black::subsystems::LinkedListAllocationSubsystem<int, 64>;
+
+        Subsystem subsystem;
+
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < Subsystem::kAllocatableObjectCount; ++i) {
+            pointers.push_back(subsystem.allocate(1));
+        }
+        EXPECT_TRUE(subsystem.full());
+
+        // free odd blocks, so no two free blocks are adjacent
+        for (std::size_t i = 1; i < pointers.size(); i += 2) {
+            EXPECT_TRUE(subsystem.deallocate(pointers[i], 1));
+        }
+        EXPECT_EQ(subsystem.allocate(2), nullptr);
+
+        // freeing even blocks merges the neighbors on both sides
+        EXPECT_TRUE(subsystem.deallocate(pointers[20], 1));
+        EXPECT_EQ(subsystem.allocate(3), pointers[19]);
+        for (std::size_t i = 0; i < pointers.size(); i += 2) {
+            if (i != 20) {
+                EXPECT_TRUE(subsystem.deallocate(pointers[i], 1));
+            }
+        }
+        EXPECT_TRUE(subsystem.deallocate(pointers[19], 3));
+        EXPECT_TRUE(subsystem.empty());
+        EXPECT_EQ(subsystem.allocate(64), pointers[0]);
+    }
+
+    TEST(concurrent, threads) {
+        black::ConcurrentBlockAllocator<int> allocator;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&allocator, t] {
+                std::vector<int *> pointers;
+                for (int ri = 0; ri < 100; ++ri) {
+                    for (int i = 0; i < 500; ++i) {
+                        auto ptr = allocator.allocate(1);
+                        *ptr = t;
+                        pointers.push_back(ptr);
+                    }
+                    for (auto ptr : pointers) {
+                        EXPECT_EQ(*ptr, t);
+                        allocator.deallocate(ptr, 1);
+                    }
+                    pointers.clear();
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    TEST(concurrent, remoteFree) {
+        using Allocator = black::ConcurrentBlockAllocator<int>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        // keeps every empty chunk
+        Allocator allocator(16);
+
+        // every chunk is full
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount * 16; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+
+        std::thread([&allocator, &pointers] {
+            for (auto ptr : pointers) {
+                allocator.deallocate(ptr, 1);
+            }
+        }).join();
+
+        // areas freed by the other thread are reused by the owner
+        std::set<int *> freed(pointers.begin(), pointers.end());
+        for (std::size_t i = 0; i < pointers.size(); ++i) {
+            EXPECT_EQ(freed.erase(allocator.allocate(1)), 1);
+        }
+    }
+
+    TEST(concurrent, shrink) {
+        black::ConcurrentBlockAllocator<int> allocator(0);
+
+        std::vector<int *> pointers;
+        for (int i = 0; i < 1000; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+        for (auto ptr : pointers) {
+            allocator.deallocate(ptr, 1);
+        }
+        allocator.shrink_to_fit();
+
+        EXPECT_NE(allocator.allocate(1), nullptr);
+    }
+
+#ifdef BLACK_HAS_MMAP
+    TEST(concurrent, fork) {
+        black::ConcurrentBlockAllocator<int> allocator(0);
+
+        // other threads refill and spill chunks through the shared pool while forking
+        std::atomic<bool> stop(false);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&allocator, &stop] {
+                std::vector<int *> pointers;
+                while (!stop.load()) {
+                    for (int i = 0; i < 1000; ++i) {
+                        pointers.push_back(allocator.allocate(1));
+                    }
+                    for (auto ptr : pointers) {
+                        allocator.deallocate(ptr, 1);
+                    }
+                    pointers.clear();
+                }
+            });
+        }
+
+        for (int i = 0; i < 20; ++i) {
+            allocator.lock_for_fork();
+            const auto pid = ::fork();
+            allocator.unlock_after_fork();
+            if (pid == 0) {
+                for (int j = 0; j < 1000; ++j) {
+                    allocator.allocate(1);
+                }
+                ::_exit(0);
+            }
+
+            int status = 0;
+            ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+            EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+
+        stop.store(true);
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+#endif
+
+    TEST(concurrent, pipeline) {
+        black::ConcurrentBlockAllocator<int> allocator;
+
+        std::mutex mutex;
+        std::deque<std::vector<int *>> batches;
+
+        // consumer frees objects which producer allocated
+        std::thread consumer([&] {
+            for (int bi = 0; bi < 200;) {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (batches.empty()) {
+                    lock.unlock();
+                    std::this_thread::yield();
+                    continue;
+                }
+                auto batch = std::move(batches.front());
+                batches.pop_front();
+                lock.unlock();
+                ++bi;
+
+                for (std::size_t i = 0; i < batch.size(); ++i) {
+                    EXPECT_EQ(*batch[i], static_cast<int>(i));
+                    allocator.deallocate(batch[i], 1);
+                }
+            }
+        });
+
+        for (int bi = 0; bi < 200; ++bi) {
+            std::vector<int *> batch;
+            for (int i = 0; i < 100; ++i) {
+                batch.push_back(allocator.allocate(1));
+                *batch.back() = i;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            batches.push_back(std::move(batch));
+        }
+        consumer.join();
+    }
+
+    TEST(atomic, stress) {
+        using Allocator =
+            black::BlockAllocator<int, black::subsystems::AtomicBitAllocationSubsystem<int>>;
+        static_assert(Allocator::kThreadSafe, "atomic subsystem is thread safe");
+
+        Allocator allocator;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&allocator, t] {
+                std::vector<int *> pointers;
+                for (int ri = 0; ri < 200; ++ri) {
+                    for (int i = 0; i < 100; ++i) {
+                        const std::size_t n = i % 3 + 1;
+                        auto ptr = allocator.allocate(n);
+                        for (std::size_t j = 0; j < n; ++j) {
+                            ptr[j] = t;
+                        }
+                        pointers.push_back(ptr);
+                    }
+                    for (std::size_t i = 0; i < pointers.size(); ++i) {
+                        const std::size_t n = i % 3 + 1;
+                        for (std::size_t j = 0; j < n; ++j) {
+                            EXPECT_EQ(pointers[i][j], t);
+                        }
+                        allocator.deallocate(pointers[i], n);
+                    }
+                    pointers.clear();
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    TEST(atomic, reuse) {
+        using Allocator =
+            black::BlockAllocator<int, black::subsystems::AtomicBitAllocationSubsystem<int>>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator;
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount * 1000; ++i) {
+            pointers.push_back(allocator.allocate(1));
+        }
+        const auto chunkCount = allocator.chunkCount();
+        EXPECT_LT(chunkCount, 1000 + Allocator::kDefaultMaxBatchNodeCount);
+
+        // freed chunks are found through the hint and the probes, not by new chunks
+        for (auto ptr : pointers) {
+            allocator.deallocate(ptr, 1);
+        }
+        for (auto &ptr : pointers) {
+            ptr = allocator.allocate(1);
+        }
+        EXPECT_LE(allocator.chunkCount(), chunkCount + Allocator::kDefaultMaxBatchNodeCount);
+    }
+
     TEST(stl, list) {
         std::list<int, black::BlockAllocator<int>> ls;
         for (std::size_t i = 0; i < 1000; ++i) {
@@ -87,6 +860,209 @@ namespace {
         }
     }
 
+    TEST(stl, list_hierarchical) {
+        std::list<int,
+                  black::BlockAllocator<
+                      int, black::subsystems::HierarchicalBitAllocationSubsystem<int, 4096>>>
+            ls;
+        for (std::size_t i = 0; i < 10000; ++i) {
+            ls.emplace_back(i);
+        }
+
+        for (std::size_t i = 0; i < 10000; ++i) {
+            EXPECT_EQ(ls.front(), i);
+            ls.pop_front();
+        }
+    }
+
+    TEST(handle, links) {
+        struct Link {
+            black::Handle<Link, black::HandleAllocator<Link>> next;
+            int value;
+        };
+        using Allocator = black::HandleAllocator<Link>;
+        static_assert(sizeof(Allocator::pointer) == 4, "handles are 32 bits");
+
+        Allocator first;
+        Allocator second;
+        Allocator::pointer heads[2];
+        for (int i = 0; i < 1000; ++i) {
+            auto &allocator = i % 2 == 0 ? first : second;
+            auto link = allocator.allocate(1);
+            link->next = heads[i % 2];
+            link->value = i;
+            heads[i % 2] = link;
+            EXPECT_EQ(Allocator::pointer::pointer_to(*link), link);
+        }
+
+        // allocators of the same type resolve handles of each other
+        for (int i = 0; i < 2; ++i) {
+            auto &allocator = i == 0 ? first : second;
+            int expected = 998 + i;
+            for (auto link = heads[i]; link != nullptr; expected -= 2) {
+                EXPECT_EQ(link->value, expected);
+                auto next = link->next;
+                allocator.deallocate(link, 1);
+                link = next;
+            }
+            EXPECT_EQ(expected, i - 2);
+        }
+
+        // ids of released chunks are reused
+        auto link = std::allocator_traits<Allocator>::allocate(first, 1);
+        EXPECT_LE(link.value() >> Allocator::kSlotBits,
+                  1000 / Allocator::AllocatorSubsystemType::kAllocatableObjectCount + 1);
+
+        Allocator::const_pointer constLink = link;
+        Allocator::void_pointer untyped = link;
+        EXPECT_EQ(constLink.get(), link.get());
+        EXPECT_EQ(static_cast<Allocator::pointer>(untyped), link);
+        std::allocator_traits<Allocator>::deallocate(first, link, 1);
+    }
+
+    TEST(shared, containers) {
+        using Allocator = black::SharedBlockAllocator<int>;
+        using Map = std::map<int, int, std::less<int>,
+                             black::SharedBlockAllocator<std::pair<const int, int>>>;
+        using UnorderedMap =
+            std::unordered_map<int, int, std::hash<int>, std::equal_to<int>,
+                               black::SharedBlockAllocator<std::pair<const int, int>>>;
+
+        Allocator allocator;
+        Map map(allocator);
+        UnorderedMap unorderedMap(0, std::hash<int>(), std::equal_to<int>(), allocator);
+        std::vector<int, Allocator> vector(allocator);
+        for (int i = 0; i < 1000; ++i) {
+            map.emplace(i, i);
+            unorderedMap.emplace(i, i);
+            vector.push_back(i);
+        }
+        EXPECT_TRUE(map.get_allocator() == allocator);
+        EXPECT_TRUE(unorderedMap.get_allocator() == allocator);
+        EXPECT_TRUE(Allocator() != allocator);
+
+        // containers of the same node type share one pool
+        Map other(allocator);
+        other.emplace(0, 0);
+        auto node = &*other.begin();
+        other.clear();
+        map.emplace(1000, 1000);
+        EXPECT_EQ(&*map.find(1000), node);
+
+        // moving does not reallocate
+        auto data = vector.data();
+        auto moved = std::move(vector);
+        EXPECT_EQ(moved.data(), data);
+        for (int i = 0; i < 1000; ++i) {
+            EXPECT_EQ(map.at(i), i);
+            EXPECT_EQ(unorderedMap.at(i), i);
+            EXPECT_EQ(moved[i], i);
+        }
+    }
+
+    /// object which counts live instances. the constructor throws for a negative value
+    struct Counted {
+        static int live;
+        int value;
+
+        explicit Counted(int v) : value(v) {
+            if (v < 0)
+                throw std::runtime_error("negative value");
+            ++live;
+        }
+        ~Counted() { --live; }
+    };
+    int Counted::live = 0;
+
+    TEST(objectPool, unique) {
+        using Pool = black::ObjectPool<Counted, black::subsystems::BitAllocationSubsystem<Counted>,
+                                       black::sources::NewDeleteSource, black::stats::Counting>;
+        static_assert(sizeof(Pool::UniquePointer) == 2 * sizeof(void *),
+                      "the deleter holds only the pool");
+
+        Pool pool;
+        {
+            std::vector<Pool::UniquePointer> objects;
+            for (int i = 0; i < 1000; ++i) {
+                objects.push_back(pool.make_unique(i));
+            }
+            EXPECT_EQ(Counted::live, 1000);
+            EXPECT_EQ(objects[500]->value, 500);
+            EXPECT_EQ(pool.pool().stats().liveObjects, 1000u);
+
+            objects.erase(objects.begin(), objects.begin() + 500);
+            EXPECT_EQ(Counted::live, 500);
+            EXPECT_EQ(pool.pool().stats().liveObjects, 500u);
+        }
+        EXPECT_EQ(Counted::live, 0);
+
+        // the block is freed if the constructor throws
+        EXPECT_THROW(pool.make_unique(-1), std::runtime_error);
+        EXPECT_EQ(pool.pool().stats().liveObjects, 0u);
+    }
+
+    TEST(objectPool, shared) {
+        black::ObjectPool<Counted> pool;
+        std::vector<std::shared_ptr<Counted>> objects;
+        for (int i = 0; i < 1000; ++i) {
+            objects.push_back(pool.make_shared(i));
+        }
+        auto kept = objects[10];
+        EXPECT_EQ(kept.use_count(), 2);
+        EXPECT_EQ(Counted::live, 1000);
+
+        // objects and control blocks are allocated from the pool of control blocks
+        EXPECT_EQ(pool.pool().chunkCount(), 1u);
+        EXPECT_EQ(pool.pool().stats().liveObjects, 0u);
+
+        objects.clear();
+        EXPECT_EQ(Counted::live, 1);
+        EXPECT_EQ(kept->value, 10);
+
+        std::weak_ptr<Counted> weak = kept;
+        kept.reset();
+        EXPECT_EQ(Counted::live, 0);
+        EXPECT_TRUE(weak.expired());
+
+        EXPECT_THROW(pool.make_shared(-1), std::runtime_error);
+    }
+
+    TEST(trace, record) {
+        using Allocator = black::RecordingAllocator<black::BlockAllocator<int>>;
+
+        std::stringstream out;
+        std::vector<int *> pointers;
+        {
+            Allocator allocator(out);
+            for (std::size_t i = 0; i < Allocator::kBufferedEventCount; ++i) {
+                pointers.push_back(allocator.allocate(1));
+            }
+            pointers.push_back(allocator.allocate(3));
+            allocator.deallocate(pointers.back(), 3);
+        }
+
+        black::trace::Header header;
+        out.read(reinterpret_cast<char *>(&header), sizeof(header));
+        EXPECT_EQ(std::memcmp(header.magic, black::trace::kMagic, sizeof(header.magic)), 0);
+        EXPECT_EQ(header.version, black::trace::kVersion);
+        EXPECT_EQ(header.objectSize, sizeof(int));
+
+        std::vector<black::trace::Event> events(pointers.size() + 1);
+        out.read(reinterpret_cast<char *>(events.data()),
+                 events.size() * sizeof(black::trace::Event));
+        EXPECT_EQ(out.gcount(), events.size() * sizeof(black::trace::Event));
+        for (std::size_t i = 0; i < pointers.size(); ++i) {
+            EXPECT_EQ(events[i].sequence, i);
+            EXPECT_EQ(events[i].kind, black::trace::kAllocate);
+            EXPECT_EQ(events[i].address, reinterpret_cast<std::uintptr_t>(pointers[i]));
+            EXPECT_EQ(events[i].thread, events[0].thread);
+        }
+        EXPECT_EQ(events.back().kind, black::trace::kDeallocate);
+        EXPECT_EQ(events.back().address, events[pointers.size() - 1].address);
+        EXPECT_EQ(events.back().count, 3);
+        EXPECT_EQ(out.peek(), EOF);
+    }
+
     TEST(stl, forward_list) {
         std::forward_list<int, black::BlockAllocator<int>> ls;
         for (std::size_t i = 1; i <= 1000; ++i) {
@@ -98,4 +1074,118 @@ namespace {
             ls.pop_front();
         }
     }
+
+#ifdef BLACK_HAS_MMAP
+    TEST(source, mmap) {
+        using Allocator = black::BlockAllocator<int, black::subsystems::BitAllocationSubsystem<int>,
+                                                black::sources::MmapSource<>>;
+        constexpr auto kCount = Allocator::AllocatorSubsystemType::kAllocatableObjectCount;
+
+        Allocator allocator(0);
+        std::vector<int *> pointers;
+        for (std::size_t i = 0; i < kCount * 100; ++i) {
+            pointers.push_back(allocator.allocate(1));
+            *pointers.back() = static_cast<int>(i);
+        }
+        for (std::size_t i = 0; i < pointers.size(); ++i) {
+            EXPECT_EQ(*pointers[i], i);
+        }
+
+        // released chunks are reused by the source
+        for (auto ptr : pointers) {
+            allocator.deallocate(ptr, 1);
+        }
+        EXPECT_EQ(allocator.chunkCount(), 0);
+        std::set<int *> freed(pointers.begin(), pointers.end());
+        EXPECT_EQ(freed.count(allocator.allocate(1)), 1);
+    }
+
+    TEST(source, mmapLarge) {
+        using Source = black::sources::MmapSource<>;
+        const auto pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+
+        // frees are called from noexcept paths of the allocators
+        Source source;
+        static_assert(noexcept(source.deallocate(nullptr, 0, 0)), "deallocate must not throw");
+
+        // small spans are kept for the same size
+        auto small = source.allocate(1000, alignof(int));
+        source.deallocate(small, 1000, alignof(int));
+        EXPECT_EQ(source.allocate(1000, alignof(int)), small);
+
+        // large spans of every size are unmapped
+        for (std::size_t bytes = Source::kUnmapThreshold; bytes < Source::kUnmapThreshold * 2;
+             bytes += Source::kUnmapThreshold / 8 + sizeof(int)) {
+            auto ptr = static_cast<char *>(source.allocate(bytes, alignof(int)));
+            std::memset(ptr, 1, bytes);
+            source.deallocate(ptr, bytes, alignof(int));
+            EXPECT_NE(::msync(ptr, pageSize, MS_ASYNC), 0);
+        }
+    }
+
+    TEST(source, hugePage) {
+        using Source = black::sources::MmapSource<black::sources::HugePage::Explicit>;
+        std::list<int, black::ConcurrentBlockAllocator<
+                           int, black::subsystems::BitAllocationSubsystem<int>, Source>>
+            ls;
+        for (std::size_t i = 0; i < 10000; ++i) {
+            ls.emplace_back(i);
+        }
+
+        for (std::size_t i = 0; i < 10000; ++i) {
+            EXPECT_EQ(ls.front(), i);
+            ls.pop_front();
+        }
+    }
+#endif
+
+#ifdef BLACK_HAS_MEMORY_RESOURCE
+    TEST(source, memoryResource) {
+        std::pmr::monotonic_buffer_resource resource;
+        using Allocator = black::BlockAllocator<int, black::subsystems::BitAllocationSubsystem<int>,
+                                                black::sources::MemoryResourceSource>;
+
+        Allocator allocator{black::sources::MemoryResourceSource(&resource)};
+        auto ptr = allocator.allocate(1);
+        *ptr = 1;
+        EXPECT_EQ(*ptr, 1);
+        allocator.deallocate(ptr, 1);
+    }
+
+    TEST(pool, sizeClasses) {
+        black::PoolResource resource;
+
+        std::vector<void *> pointers;
+        for (std::size_t bytes = 1; bytes <= black::PoolResource::kMaxBlockSize; ++bytes) {
+            const std::size_t alignment = bytes % 16 == 0 ? 16 : 1;
+            auto ptr = resource.allocate(bytes, alignment);
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr) % alignment, 0);
+            std::memset(ptr, 0xff, bytes);
+            pointers.push_back(ptr);
+        }
+        std::set<void *> unique(pointers.begin(), pointers.end());
+        EXPECT_EQ(unique.size(), pointers.size());
+        for (std::size_t bytes = 1; bytes <= pointers.size(); ++bytes) {
+            resource.deallocate(pointers[bytes - 1], bytes, bytes % 16 == 0 ? 16 : 1);
+        }
+
+        // larger requests are served by the upstream
+        auto large = resource.allocate(4096, 64);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(large) % 64, 0);
+        resource.deallocate(large, 4096, 64);
+    }
+
+    TEST(pool, containers) {
+        black::PoolResource resource;
+        std::pmr::map<int, std::pmr::string> map(&resource);
+        for (int i = 0; i < 1000; ++i) {
+            map.emplace(i, std::string(i % 100, 'a'));
+        }
+        for (int i = 0; i < 1000; ++i) {
+            EXPECT_EQ(map.at(i).size(), i % 100);
+        }
+        map.clear();
+        resource.shrink_to_fit();
+    }
+#endif
 } // namespace